@@ -3,7 +3,116 @@
 #include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/interprocess/detail/atomic.hpp>
-#include <iostream>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// MakeBluetoothEndpoint definition
+StreamEndpoint MakeBluetoothEndpoint(const std::string &addr, uint8_t channel)
+{
+	return StreamEndpoint(boost::asio::bluetooth::bluetooth::endpoint(addr, channel));
+}
+
+// MakeTcpEndpoint definition
+StreamEndpoint MakeTcpEndpoint(const std::string &host, uint16_t port)
+{
+	boost::system::error_code ec;
+	boost::asio::ip::address address = host == "localhost" ? boost::asio::ip::address_v4::loopback() : boost::asio::ip::make_address(host, ec);
+	if(ec)
+		throw std::invalid_argument("Bad tcp address: " + host);
+	return StreamEndpoint(boost::asio::ip::tcp::endpoint(address, port));
+}
+
+// MakeUnixEndpoint definition
+StreamEndpoint MakeUnixEndpoint(const std::string &path)
+{
+	return StreamEndpoint(boost::asio::local::stream_protocol::endpoint(path));
+}
+
+// ParseEndpoint definition
+StreamEndpoint ParseEndpoint(const std::string &spec)
+{
+	std::size_t colon = spec.find(':');
+	std::string scheme = spec.substr(0, colon);
+	std::string rest = colon == std::string::npos ? std::string() : spec.substr(colon + 1);
+	try
+	{
+		if(scheme == "bt")
+		{
+			std::size_t slash = rest.rfind('/');
+			if(slash != std::string::npos)
+				return MakeBluetoothEndpoint(rest.substr(0, slash), static_cast<uint8_t>(std::stoi(rest.substr(slash + 1))));
+		}
+		else if(scheme == "tcp")
+		{
+			std::size_t port = rest.rfind(':');
+			if(port != std::string::npos)
+				return MakeTcpEndpoint(rest.substr(0, port), static_cast<uint16_t>(std::stoi(rest.substr(port + 1))));
+		}
+		else if(scheme == "unix" && !rest.empty())
+			return MakeUnixEndpoint(rest);
+	}
+	catch(const std::logic_error &)
+	{
+		// Bad number or a path too long for sockaddr_un, reported below
+	}
+	throw std::invalid_argument("Bad endpoint: " + spec);
+}
+
+namespace
+{
+	LogHandler log_handler;
+
+	void Log(const std::string &message)
+	{
+		if(log_handler)
+			log_handler(message);
+	}
+}
+
+// SetLogHandler definition
+void SetLogHandler(LogHandler handler)
+{
+	log_handler = handler;
+}
+
+// GetEndpointAddress definition
+std::string GetEndpointAddress(const StreamEndpoint &endpoint, uint8_t &channel)
+{
+	channel = 0;
+	switch(endpoint.protocol().family())
+	{
+	case AF_BLUETOOTH:
+	{
+		const sockaddr_rc *rc = reinterpret_cast<const sockaddr_rc *>(endpoint.data());
+		char addr[18];
+		std::snprintf(addr, sizeof(addr), "%02X:%02X:%02X:%02X:%02X:%02X", rc->rc_bdaddr.b[5], rc->rc_bdaddr.b[4], rc->rc_bdaddr.b[3], rc->rc_bdaddr.b[2], rc->rc_bdaddr.b[1], rc->rc_bdaddr.b[0]);
+		channel = rc->rc_channel;
+		return addr;
+	}
+	case AF_INET:
+	case AF_INET6:
+	{
+		boost::asio::ip::tcp::endpoint tcp;
+		std::memcpy(tcp.data(), endpoint.data(), std::min(endpoint.size(), tcp.capacity()));
+		return tcp.address().to_string() + ":" + std::to_string(tcp.port());
+	}
+	case AF_UNIX:
+	{
+		boost::asio::local::stream_protocol::endpoint local;
+		std::memcpy(local.data(), endpoint.data(), std::min(endpoint.size(), local.capacity()));
+		local.resize(std::min(endpoint.size(), local.capacity()));
+		return local.path();
+	}
+	default:
+		return std::string();
+	}
+}
 
 // Hive constructor
 Hive::Hive()
@@ -40,6 +149,16 @@ void Hive::Run()
 	m_io_service.run();
 }
 
+// Hive::Run definition [thread pool]
+void Hive::Run(uint32_t thread_count)
+{
+	boost::thread_group threads;
+	for(uint32_t i = 1; i < thread_count; ++i)
+		threads.create_thread([this] { m_io_service.run(); });
+	m_io_service.run();
+	threads.join_all();
+}
+
 // Hive::Stop definition
 void Hive::Stop()
 {
@@ -116,22 +235,25 @@ void Acceptor::HandleAccept(const boost::system::error_code &error, boost::share
 {
 	if(error || HasError() || m_hive->HasStopped())
 	{
-		std::cout << "Acceptor::HandleAccept has error!" << std::endl;
+		Log("Accept failed: " + error.message());
 		connection->StartError(error);
 	}
 	else
 	{
 		if(connection->GetSocket().is_open())
 		{
-			std::cout << "Acceptor::HandleAccept succeed!" << std::endl;
 			connection->StartTimer();
-			if(OnAccept(connection, connection->GetSocket().remote_endpoint().address(), connection->GetSocket().remote_endpoint().channel()))
+			boost::system::error_code ec;
+			uint8_t channel = 0;
+			std::string addr = GetEndpointAddress(connection->GetSocket().remote_endpoint(ec), channel);
+			if(OnAccept(connection, addr, channel))
 			{
-				connection->OnAccept(m_acceptor.local_endpoint().address(), m_acceptor.local_endpoint().channel());
+				addr = GetEndpointAddress(m_acceptor.local_endpoint(ec), channel);
+				connection->OnAccept(addr, channel);
 			}
 		}
 		else {
-			std::cout << "Acceptor::HandleAccept has error!" << std::endl;
+			Log("Accepted socket is closed");
 			StartError(error);
 		}
 	}
@@ -150,36 +272,38 @@ void Acceptor::Accept(boost::shared_ptr<Connection> connection)
 }
 
 // Acceptor::Listen definition
-void Acceptor::Listen(const std::string &mac_addr, const uint8_t & channel)
+void Acceptor::Listen(const StreamEndpoint &endpoint)
 {
-	boost::asio::bluetooth::bluetooth::endpoint endpoint(mac_addr, channel);
 	m_acceptor.open(endpoint.protocol());
-	//m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(false));
+	if(endpoint.protocol().family() == AF_INET || endpoint.protocol().family() == AF_INET6)
+		m_acceptor.set_option(boost::asio::socket_base::reuse_address(true));
+	else if(endpoint.protocol().family() == AF_UNIX)
+	{
+		// A socket file left by an earlier run would make bind fail
+		uint8_t channel;
+		::unlink(GetEndpointAddress(endpoint, channel).c_str());
+	}
 	m_acceptor.bind(endpoint);
 	m_acceptor.listen(boost::asio::socket_base::max_connections);
 	StartTimer();
 }
 
+// Acceptor::Listen definition
+void Acceptor::Listen(const std::string &mac_addr, const uint8_t & channel)
+{
+	Listen(MakeBluetoothEndpoint(mac_addr, channel));
+}
+
 // Acceptor::Listen definition [default]
 void Acceptor::Listen()
 {
-	boost::asio::bluetooth::bluetooth::endpoint endpoint;
-	m_acceptor.open(endpoint.protocol());
-	//m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(false));
-	m_acceptor.bind(endpoint);
-	m_acceptor.listen(boost::asio::socket_base::max_connections);
-	StartTimer();
+	Listen(StreamEndpoint(boost::asio::bluetooth::bluetooth::endpoint()));
 }
 
 // Acceptor::Listen definition [default]
 void Acceptor::Listen(uint8_t channel)
 {
-	boost::asio::bluetooth::bluetooth::endpoint endpoint(channel);
-	m_acceptor.open(endpoint.protocol());
-	//m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(false));
-	m_acceptor.bind(endpoint);
-	m_acceptor.listen(boost::asio::socket_base::max_connections);
-	StartTimer();
+	Listen(StreamEndpoint(boost::asio::bluetooth::bluetooth::endpoint(channel)));
 }
 
 // Acceptor::GetHive definition
@@ -189,7 +313,7 @@ boost::shared_ptr<Hive> Acceptor::GetHive()
 }
 
 // Acceptor::GetAcceptor definition
-boost::asio::bluetooth::bluetooth::acceptor &Acceptor::GetAcceptor()
+StreamAcceptor &Acceptor::GetAcceptor()
 {
 	return m_acceptor;
 }
@@ -214,7 +338,7 @@ bool Acceptor::HasError()
 
 // Connection constructor
 Connection::Connection(boost::shared_ptr<Hive> hive)
-		: m_hive(hive), m_socket(hive->GetService()), m_io_strand(hive->GetService()), m_timer(hive->GetService()), m_receive_buffer_size(4096), m_timer_interval(1000), m_error_state(0)
+		: m_hive(hive), m_socket(hive->GetService()), m_io_strand(hive->GetService()), m_timer(hive->GetService()), m_recv_begin(0), m_recv_end(0), m_receive_buffer_size(4096), m_timer_interval(1000), m_error_state(0)
 {
 }
 
@@ -229,7 +353,12 @@ void Connection::Bind(const std::string &addr, uint8_t channel)
 	// std::string dest = "60:57:18:7E:77:68";
 
 
-	boost::asio::bluetooth::bluetooth::endpoint endpoint(addr, channel);
+	Bind(MakeBluetoothEndpoint(addr, channel));
+}
+
+// Connection::Bind definition
+void Connection::Bind(const StreamEndpoint &endpoint)
+{
 	m_socket.open(endpoint.protocol());
 	m_socket.bind(endpoint);
 }
@@ -237,24 +366,55 @@ void Connection::Bind(const std::string &addr, uint8_t channel)
 // Connection::StartSend definition
 void Connection::StartSend()
 {
-	if(!m_pending_sends.empty())
+	if(!m_pending_sends.empty() && m_inflight_sends.empty())
+	{
+		// Gather everything queued so far into one write
+		m_inflight_sends.swap(m_pending_sends);
+		m_send_sequence.clear();
+		for(const auto &buffer : m_inflight_sends)
+			m_send_sequence.push_back(boost::asio::buffer(buffer));
+		boost::asio::async_write(m_socket, m_send_sequence, m_io_strand.wrap(boost::bind(&Connection::HandleSend, shared_from_this(), boost::asio::placeholders::error)));
+	}
+}
+
+// Connection::PrepareRecv definition
+void Connection::PrepareRecv(std::size_t total_bytes)
+{
+	if(m_recv_buffer.size() < static_cast<std::size_t>(m_receive_buffer_size))
+		m_recv_buffer.resize(m_receive_buffer_size);
+
+	// Move the unconsumed bytes to the front, they are usually a few bytes of a split message
+	if(m_recv_begin > 0 && m_recv_buffer.size() - m_recv_end < std::max<std::size_t>(total_bytes, 1))
 	{
-		boost::asio::async_write(m_socket, boost::asio::buffer(m_pending_sends.front()), m_io_strand.wrap(boost::bind(&Connection::HandleSend, shared_from_this(), boost::asio::placeholders::error, m_pending_sends.begin())));
+		std::memmove(m_recv_buffer.data(), m_recv_buffer.data() + m_recv_begin, m_recv_end - m_recv_begin);
+		m_recv_end -= m_recv_begin;
+		m_recv_begin = 0;
+	}
+
+	if(total_bytes > 0)
+	{
+		if(m_recv_buffer.size() - m_recv_end < total_bytes)
+			m_recv_buffer.resize(m_recv_end + total_bytes);
+	}
+	else if(m_recv_end == m_recv_buffer.size())
+	{
+		// The consumer made no progress on a full buffer, drop the stale data
+		m_recv_begin = 0;
+		m_recv_end = 0;
 	}
 }
 
 // Connection::StartRecv definition
 void Connection::StartRecv(int32_t total_bytes)
 {
+	PrepareRecv(total_bytes > 0 ? total_bytes : 0);
 	if(total_bytes > 0)
 	{
-		m_recv_buffer.resize(total_bytes);
-		boost::asio::async_read(m_socket, boost::asio::buffer(m_recv_buffer), m_io_strand.wrap(boost::bind(&Connection::HandleRecv, shared_from_this(), _1, _2)));
+		boost::asio::async_read(m_socket, boost::asio::buffer(m_recv_buffer.data() + m_recv_end, total_bytes), m_io_strand.wrap(boost::bind(&Connection::HandleRecv, shared_from_this(), _1, _2)));
 	}
 	else
 	{
-		m_recv_buffer.resize(m_receive_buffer_size);
-		m_socket.async_read_some(boost::asio::buffer(m_recv_buffer), m_io_strand.wrap(boost::bind(&Connection::HandleRecv, shared_from_this(), _1, _2)));
+		m_socket.async_read_some(boost::asio::buffer(m_recv_buffer.data() + m_recv_end, m_recv_buffer.size() - m_recv_end), m_io_strand.wrap(boost::bind(&Connection::HandleRecv, shared_from_this(), _1, _2)));
 	}
 }
 
@@ -272,9 +432,11 @@ void Connection::StartError(const boost::system::error_code &error)
 	if(error != boost::system::errc::success)
 	{
 		boost::system::error_code ec;
-		m_socket.shutdown(boost::asio::bluetooth::bluetooth::socket::shutdown_both, ec);
+		m_socket.shutdown(StreamSocket::shutdown_both, ec);
 		m_socket.close(ec);
 		m_timer.cancel(ec);
+		m_recv_begin = 0;
+		m_recv_end = 0;
 		OnError(error);
 	}
 }
@@ -282,16 +444,20 @@ void Connection::StartError(const boost::system::error_code &error)
 // Connection::HandleConnect definition
 void Connection::HandleConnect(const boost::system::error_code &error)
 {
-	std::cout << "Connection::HandleConnect()" << std::endl;
 	if(error != boost::system::errc::success || m_hive->HasStopped())
 	{
-		std::cout << "Handle connect has error: " << error.message() << std::endl;
+		Log("Connect failed: " + error.message());
 		StartError( error );
 	}
 	else
 	{
+		boost::system::error_code ec;
+		uint8_t channel = 0;
+		std::string addr;
 		if(m_socket.is_open())
-			OnConnect( m_socket.remote_endpoint().address(), m_socket.remote_endpoint().channel() );
+			addr = GetEndpointAddress(m_socket.remote_endpoint(ec), channel);
+		if(m_socket.is_open() && !ec)
+			OnConnect( addr, channel );
 		else {
 			StartError( error );
 		}
@@ -299,18 +465,24 @@ void Connection::HandleConnect(const boost::system::error_code &error)
 }
 
 // Connection::HandleSend definition
-void Connection::HandleSend(const boost::system::error_code &error, std::list<std::vector<uint8_t> >::iterator itr)
+void Connection::HandleSend(const boost::system::error_code &error)
 {
-	std::cout << "Connection::HandleSend()" << std::endl;
 	if(error != boost::system::errc::success || m_hive->HasStopped())
 	{
-		std::cout << "Connection::HandleSend() has error"  << error.message() << std::endl;
+		Log("Send failed: " + error.message());
+		// Drop what was not sent, so a later connect starts with an empty queue
+		m_inflight_sends.clear();
+		m_pending_sends.clear();
 		StartError(error);
 	}
 	else
 	{
-		OnSend(*itr);
-		m_pending_sends.erase(itr);
+		for(auto &buffer : m_inflight_sends)
+		{
+			OnSend(buffer);
+			ReleaseBuffer(buffer);
+		}
+		m_inflight_sends.clear();
 		StartSend();
 	}
 }
@@ -322,8 +494,14 @@ void Connection::HandleRecv(const boost::system::error_code &error, int32_t actu
 		StartError( error );
 	else
 	{
-		m_recv_buffer.resize(actual_bytes);
-		OnRecv(m_recv_buffer);
+		m_recv_end += actual_bytes;
+		std::size_t consumed = OnRecv(m_recv_buffer.data() + m_recv_begin, m_recv_end - m_recv_begin);
+		m_recv_begin += std::min(consumed, m_recv_end - m_recv_begin);
+		if(m_recv_begin == m_recv_end)
+		{
+			m_recv_begin = 0;
+			m_recv_end = 0;
+		}
 		m_pending_recvs.pop_front();
 		if(!m_pending_recvs.empty())
 			StartRecv( m_pending_recvs.front() );
@@ -343,12 +521,33 @@ void Connection::HandleTimer(const boost::system::error_code &error)
 }
 
 // Connection::DispatchSend definition
-void Connection::DispatchSend(std::vector<uint8_t> buffer)
+void Connection::DispatchSend(std::vector<uint8_t> &buffer)
 {
-	bool should_start_send = m_pending_sends.empty();
-	m_pending_sends.push_back(buffer);
-	if(should_start_send)
-		StartSend();
+	m_pending_sends.push_back(std::move(buffer));
+	StartSend();
+}
+
+// Connection::ReleaseBuffer definition
+void Connection::ReleaseBuffer(std::vector<uint8_t> &buffer)
+{
+	// Keep a bounded number of small buffers, large ones would pin memory
+	boost::mutex::scoped_lock lock(m_buffer_pool_lock);
+	if(m_buffer_pool.size() < 64 && buffer.capacity() <= 4096)
+	{
+		buffer.clear();
+		m_buffer_pool.push_back(std::move(buffer));
+	}
+}
+
+// Connection::AcquireBuffer definition
+std::vector<uint8_t> Connection::AcquireBuffer()
+{
+	boost::mutex::scoped_lock lock(m_buffer_pool_lock);
+	if(m_buffer_pool.empty())
+		return std::vector<uint8_t>();
+	std::vector<uint8_t> buffer = std::move(m_buffer_pool.back());
+	m_buffer_pool.pop_back();
+	return buffer;
 }
 
 // Connection::DispatchRecv definition
@@ -369,13 +568,32 @@ void Connection::DispatchTimer(const boost::system::error_code &error)
 // Connection::Connect definition
 void Connection::Connect(const std::string & addr, uint8_t channel)
 {
-	boost::system::error_code ec;
+	Connect(MakeBluetoothEndpoint(addr, channel));
+}
 
-	boost::asio::bluetooth::bluetooth::endpoint endpoint(addr, channel);
+// Connection::Connect definition
+void Connection::Connect(const StreamEndpoint &endpoint)
+{
 	m_socket.async_connect(endpoint, m_io_strand.wrap(boost::bind(&Connection::HandleConnect, shared_from_this(), _1)));
 	StartTimer();
 }
 
+// Connection::ConnectPair definition
+void Connection::ConnectPair(boost::shared_ptr<Connection> first, boost::shared_ptr<Connection> second)
+{
+	int fds[2];
+	if(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		throw boost::system::system_error(errno, boost::system::system_category(), "socketpair");
+
+	const boost::asio::generic::stream_protocol protocol(AF_UNIX, 0);
+	first->m_socket.assign(protocol, fds[0]);
+	second->m_socket.assign(protocol, fds[1]);
+	first->m_io_strand.post(boost::bind(&Connection::HandleConnect, first, boost::system::error_code()));
+	second->m_io_strand.post(boost::bind(&Connection::HandleConnect, second, boost::system::error_code()));
+	first->StartTimer();
+	second->StartTimer();
+}
+
 // Connection::Disconnect definition
 void Connection::Disconnect()
 {
@@ -391,11 +609,22 @@ void Connection::Recv(int32_t total_bytes)
 // Connection::Send definition
 void Connection::Send(const std::vector<uint8_t> &buffer)
 {
-	m_io_strand.post(boost::bind(&Connection::DispatchSend, shared_from_this(), buffer));
+	std::vector<uint8_t> copy = AcquireBuffer();
+	copy.assign(buffer.begin(), buffer.end());
+	Send(std::move(copy));
+}
+
+// Connection::Send definition
+void Connection::Send(std::vector<uint8_t> &&buffer)
+{
+	boost::shared_ptr<Connection> self = shared_from_this();
+	m_io_strand.post([self, buffer = std::move(buffer)]() mutable {
+		self->DispatchSend(buffer);
+	});
 }
 
 // Connection::GetSocket definition
-boost::asio::bluetooth::bluetooth::socket &Connection::GetSocket()
+StreamSocket &Connection::GetSocket()
 {
 	return m_socket;
 }
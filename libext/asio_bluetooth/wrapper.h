@@ -4,15 +4,47 @@
 
 // Include the required header files
 #include <boost/asio.hpp>
+#include <boost/asio/generic/stream_protocol.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 #include <string>
 #include <vector>
 #include <list>
 #include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
 #include "asio_bluetooth/bluetooth.hpp"
 
+// Stream socket types independent of the address family. Acceptors and
+// connections only use these, the family (RFCOMM, TCP or Unix domain) is
+// chosen by the endpoint they are given.
+typedef boost::asio::generic::stream_protocol::socket StreamSocket;
+typedef boost::asio::basic_socket_acceptor<boost::asio::generic::stream_protocol> StreamAcceptor;
+typedef boost::asio::generic::stream_protocol::endpoint StreamEndpoint;
+
+// Returns an RFCOMM endpoint.
+StreamEndpoint MakeBluetoothEndpoint(const std::string &addr, boost::uint8_t channel);
+
+// Returns a TCP endpoint. The host must be a numeric address or "localhost".
+StreamEndpoint MakeTcpEndpoint(const std::string &host, boost::uint16_t port);
+
+// Returns a Unix domain socket endpoint.
+StreamEndpoint MakeUnixEndpoint(const std::string &path);
+
+// Parses "bt:<mac>/<channel>", "tcp:<host>:<port>" or "unix:<path>". Throws
+// std::invalid_argument if the string is not one of them.
+StreamEndpoint ParseEndpoint(const std::string &spec);
+
+// Returns the printable address of the endpoint and its RFCOMM channel. TCP
+// ports are part of the address, the channel is 0 for everything but RFCOMM.
+std::string GetEndpointAddress(const StreamEndpoint &endpoint, boost::uint8_t &channel);
+
+// Receives the diagnostics of the wrapper, they are dropped until a handler is
+// set. Set it before any Hive runs, it is not synchronized.
+typedef boost::function<void(const std::string &)> LogHandler;
+void SetLogHandler(LogHandler handler);
+
 // Class declaration
 class Hive;
 class Acceptor;
@@ -50,6 +82,12 @@ public:
 	// unless you code in such logic.
 	void Run();
 
+	// Runs the networking system on thread_count threads, the calling thread
+	// being one of them, and blocks until it is stopped. Handlers of different
+	// connections run in parallel, those of one connection are still serialized
+	// by its strand.
+	void Run(boost::uint32_t thread_count);
+
 	// Stops the networking system. All work is finished and no more
 	// networking interactions will be possible afterwards until Reset is called.
 	void Stop();
@@ -66,7 +104,7 @@ class Acceptor : public boost::enable_shared_from_this<Acceptor>
 
 private:
 	boost::shared_ptr< Hive > m_hive;
-	boost::asio::bluetooth::bluetooth::acceptor m_acceptor;
+	StreamAcceptor m_acceptor;
 	boost::asio::io_context::strand m_io_strand;
 	boost::asio::deadline_timer m_timer;
 	boost::posix_time::ptime m_last_time;
@@ -107,7 +145,7 @@ public:
 	boost::shared_ptr<Hive> GetHive();
 
 	// Returns the acceptor object.
-	boost::asio::bluetooth::bluetooth::acceptor &GetAcceptor();
+	StreamAcceptor &GetAcceptor();
 
 	// Returns the strand object.
 	boost::asio::io_context::strand &GetStrand();
@@ -123,6 +161,10 @@ public:
 	bool HasError();
 
 public:
+	// Begin listening on the endpoint. Any address family supported by
+	// StreamEndpoint can be used.
+	void Listen(const StreamEndpoint &endpoint);
+
 	// Begin listening on the specific bluetooth interface.
 	void Listen(const std::string &host, const boost::uint8_t &port);
 
@@ -149,13 +191,19 @@ class Connection : public boost::enable_shared_from_this<Connection>
 
 private:
 	boost::shared_ptr<Hive> m_hive;
-	boost::asio::bluetooth::bluetooth::socket m_socket;
+	StreamSocket m_socket;
 	boost::asio::io_context::strand m_io_strand;
 	boost::asio::deadline_timer m_timer;
 	boost::posix_time::ptime m_last_time;
 	std::vector<boost::uint8_t> m_recv_buffer;
+	std::size_t m_recv_begin;
+	std::size_t m_recv_end;
 	std::list<boost::int32_t> m_pending_recvs;
-	std::list<std::vector<boost::uint8_t> > m_pending_sends;
+	std::vector<std::vector<boost::uint8_t> > m_pending_sends;
+	std::vector<std::vector<boost::uint8_t> > m_inflight_sends;
+	std::vector<boost::asio::const_buffer> m_send_sequence;
+	boost::mutex m_buffer_pool_lock;
+	std::vector<std::vector<boost::uint8_t> > m_buffer_pool;
 	boost::int32_t m_receive_buffer_size;
 	boost::int32_t m_timer_interval;
 	volatile boost::uint32_t m_error_state;
@@ -169,13 +217,15 @@ private:
 	Connection & operator =(const Connection &rhs);
 	void StartSend();
 	void StartRecv(boost::int32_t total_bytes);
+	void PrepareRecv(std::size_t total_bytes);
 	void StartTimer();
 	void StartError(const boost::system::error_code &error);
-	void DispatchSend(std::vector<boost::uint8_t> buffer);
+	void DispatchSend(std::vector<boost::uint8_t> &buffer);
 	void DispatchRecv(boost::int32_t total_bytes);
 	void DispatchTimer(const boost::system::error_code &error);
 	void HandleConnect(const boost::system::error_code &error);
-	void HandleSend(const boost::system::error_code &error, std::list<std::vector<boost::uint8_t> >::iterator itr);
+	void HandleSend(const boost::system::error_code &error);
+	void ReleaseBuffer(std::vector<boost::uint8_t> &buffer);
 	void HandleRecv(const boost::system::error_code &error, boost::int32_t actual_bytes );
 	void HandleTimer(const boost::system::error_code &error);
 
@@ -191,8 +241,10 @@ private:
 	// Called when data has been sent by the connection.
 	virtual void OnSend(const std::vector<boost::uint8_t> &buffer) = 0;
 
-	// Called when data has been received by the connection.
-	virtual void OnRecv(std::vector<boost::uint8_t> &buffer ) = 0;
+	// Called when data has been received by the connection. The view covers
+	// the new data and any bytes which were not consumed by earlier calls.
+	// Returns the number of bytes consumed, the rest is kept for the next call.
+	virtual std::size_t OnRecv(const boost::uint8_t *data, std::size_t size) = 0;
 
 	// Called on each timer event.
 	virtual void OnTimer(const boost::posix_time::time_duration &delta) = 0;
@@ -205,7 +257,7 @@ public:
 	boost::shared_ptr<Hive> GetHive();
 
 	// Returns the socket object.
-	boost::asio::bluetooth::bluetooth::socket &GetSocket();
+	StreamSocket &GetSocket();
 
 	// Returns the strand object.
 	boost::asio::io_context::strand &GetStrand();
@@ -233,12 +285,30 @@ public:
 	// Binds the socket to the specified interface.
 	void Bind(const std::string &addr, boost::uint8_t channel);
 
+	// Binds the socket to the specified endpoint.
+	void Bind(const StreamEndpoint &endpoint);
+
 	// Starts an a/synchronous connect.
 	void Connect(const std::string &addr, boost::uint8_t channel);
 
+	// Starts an a/synchronous connect to an endpoint of any address family.
+	void Connect(const StreamEndpoint &endpoint);
+
+	// Connects two connections of the same process with a socketpair. Both
+	// get OnConnect as if they had connected to each other.
+	static void ConnectPair(boost::shared_ptr<Connection> first, boost::shared_ptr<Connection> second);
+
 	// Posts data to be sent to the connection.
 	void Send(const std::vector<boost::uint8_t> &buffer);
 
+	// Posts data to be sent to the connection without copying it. Everything
+	// queued while a write is in progress goes out in the next single write.
+	void Send(std::vector<boost::uint8_t> &&buffer);
+
+	// Returns an empty buffer from the pool of sent buffers. Filling it and
+	// passing it to Send avoids allocations once the pool is warm.
+	std::vector<boost::uint8_t> AcquireBuffer();
+
 	// Posts a recv for the connection to process. If total_bytes is 0, then
 	// as many bytes as possible up to GetReceiveBufferSize() will be
 	// waited for. If Recv is not 0, then the connection will wait for exactly
@@ -0,0 +1,160 @@
+#include "capture.h"
+#include <chrono>
+#include <cstring>
+
+namespace rb {
+
+    namespace {
+        // Buffered records above this size are dropped, the disk is not keeping up
+        const std::size_t MAX_PENDING = 4 * 1024 * 1024;
+        // The writer wakes up at least this often, or earlier when a quarter of the limit is buffered
+        const auto WRITE_INTERVAL = std::chrono::milliseconds(100);
+
+        void putLittleEndian(uint8_t *out, uint64_t value, std::size_t size) {
+            for (std::size_t i = 0; i < size; ++i) {
+                out[i] = static_cast<uint8_t>(value >> (8 * i));
+            }
+        }
+
+        uint64_t getLittleEndian(const uint8_t *in, std::size_t size) {
+            uint64_t value = 0;
+            for (std::size_t i = 0; i < size; ++i) {
+                value |= static_cast<uint64_t>(in[i]) << (8 * i);
+            }
+            return value;
+        }
+    }
+
+    uint64_t captureTime() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    CaptureWriter::~CaptureWriter() {
+        this->close();
+    }
+
+    bool CaptureWriter::open(const std::string &path) {
+        this->close();
+
+        std::FILE *file = std::fopen(path.c_str(), "ab");
+        if (file == nullptr) return false;
+
+        // A new file gets the header, an existing capture is continued
+        std::fseek(file, 0, SEEK_END);
+        if (std::ftell(file) == 0) {
+            uint8_t header[capture::FILE_HEADER_SIZE] = {};
+            std::memcpy(header, capture::MAGIC, sizeof(capture::MAGIC));
+            header[sizeof(capture::MAGIC)] = capture::VERSION;
+            std::fwrite(header, 1, sizeof(header), file);
+        }
+
+        this->_file = file;
+        this->_running = true;
+        this->_writer = std::thread(&CaptureWriter::writerMain, this);
+        return true;
+    }
+
+    void CaptureWriter::close() {
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            if (!this->_running) return;
+            this->_running = false;
+        }
+        this->_condVar.notify_all();
+        if (this->_writer.joinable()) this->_writer.join();
+        std::fclose(this->_file);
+        this->_file = nullptr;
+    }
+
+    bool CaptureWriter::isOpen() const {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        return this->_running;
+    }
+
+    void CaptureWriter::write(uint8_t stream, CaptureKind kind, const uint8_t *data, std::size_t size) {
+        uint8_t header[capture::RECORD_HEADER_SIZE];
+        putLittleEndian(header, captureTime(), 8);
+        header[8] = stream;
+        header[9] = static_cast<uint8_t>(kind);
+        putLittleEndian(header + 10, size, 4);
+
+        bool wake = false;
+        {
+            std::lock_guard<std::mutex> lock(this->_mutex);
+            if (!this->_running) return;
+            if (this->_pending.size() + sizeof(header) + size > MAX_PENDING) {
+                ++this->_dropped;
+                return;
+            }
+            this->_pending.insert(this->_pending.end(), header, header + sizeof(header));
+            if (size > 0) this->_pending.insert(this->_pending.end(), data, data + size);
+            wake = this->_pending.size() > MAX_PENDING / 4;
+        }
+        if (wake) this->_condVar.notify_one();
+    }
+
+    std::size_t CaptureWriter::getDropped() const {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        return this->_dropped;
+    }
+
+    void CaptureWriter::writerMain() {
+        std::vector<uint8_t> writing;
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        while (true) {
+            this->_condVar.wait_for(lock, WRITE_INTERVAL, [this] {
+                return !this->_running || this->_pending.size() > MAX_PENDING / 4;
+            });
+            const bool running = this->_running;
+            writing.swap(this->_pending);
+            lock.unlock();
+
+            if (!writing.empty()) {
+                std::fwrite(writing.data(), 1, writing.size(), this->_file);
+                std::fflush(this->_file);
+                writing.clear();
+            }
+
+            lock.lock();
+            if (!running && this->_pending.empty()) break;
+        }
+    }
+
+    CaptureReader::~CaptureReader() {
+        if (this->_file != nullptr) std::fclose(this->_file);
+    }
+
+    bool CaptureReader::open(const std::string &path) {
+        if (this->_file != nullptr) std::fclose(this->_file);
+        this->_file = std::fopen(path.c_str(), "rb");
+        if (this->_file == nullptr) return false;
+
+        uint8_t header[capture::FILE_HEADER_SIZE];
+        if (std::fread(header, 1, sizeof(header), this->_file) != sizeof(header) ||
+            std::memcmp(header, capture::MAGIC, sizeof(capture::MAGIC)) != 0 ||
+            header[sizeof(capture::MAGIC)] != capture::VERSION) {
+            std::fclose(this->_file);
+            this->_file = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    bool CaptureReader::next(CaptureRecord &record) {
+        if (this->_file == nullptr) return false;
+
+        uint8_t header[capture::RECORD_HEADER_SIZE];
+        if (std::fread(header, 1, sizeof(header), this->_file) != sizeof(header)) return false;
+
+        record.time = getLittleEndian(header, 8);
+        record.stream = header[8];
+        record.kind = static_cast<CaptureKind>(header[9]);
+        const uint64_t size = getLittleEndian(header + 10, 4);
+        // A writer never buffers more than this, a larger size is a corrupted file
+        if (size > MAX_PENDING) return false;
+        record.data.resize(size);
+        return record.data.empty() ||
+               std::fread(record.data.data(), 1, record.data.size(), this->_file) == record.data.size();
+    }
+}
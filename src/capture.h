@@ -0,0 +1,105 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace rb {
+
+    /*
+     * Capture file layout, multi-byte fields are little endian:
+     *   "RBCAP" version (1) reserved (2)
+     *   records: time ns (8) | stream (1) | kind (1) | size (4) | data
+     * Times come from the monotonic clock, only differences between them are meaningful.
+     */
+    namespace capture {
+        const char MAGIC[] = {'R', 'B', 'C', 'A', 'P'};
+        const uint8_t VERSION = 1;
+        const std::size_t FILE_HEADER_SIZE = 8;
+        const std::size_t RECORD_HEADER_SIZE = 14;
+    }
+
+    enum class CaptureKind : uint8_t {
+        // Bytes written to the robot
+        Sent = 1,
+        // Bytes read from the robot
+        Received = 2,
+        Connected = 3,
+        Closed = 4
+    };
+
+    struct CaptureRecord {
+        uint64_t time = 0;
+        // Robot the record belongs to
+        uint8_t stream = 0;
+        CaptureKind kind = CaptureKind::Sent;
+        std::vector<uint8_t> data;
+    };
+
+    /*
+     * Appends records to a capture file. write only copies the record into memory, a background
+     * thread writes the buffer to the file, so it is cheap enough to call on the I/O strand.
+     */
+    class CaptureWriter {
+    public:
+        CaptureWriter() = default;
+
+        ~CaptureWriter();
+
+        // Opens the file for appending, returns false if it could not be opened
+        bool open(const std::string &path);
+
+        // Writes the buffered records and closes the file
+        void close();
+
+        bool isOpen() const;
+
+        void write(uint8_t stream, CaptureKind kind, const uint8_t *data = nullptr, std::size_t size = 0);
+
+        // Records dropped because the file could not keep up
+        std::size_t getDropped() const;
+
+    private:
+        CaptureWriter(const CaptureWriter &) = delete;
+
+        CaptureWriter &operator=(const CaptureWriter &) = delete;
+
+        void writerMain();
+
+        std::FILE *_file = nullptr;
+        std::thread _writer;
+
+        mutable std::mutex _mutex;
+        std::condition_variable _condVar;
+        std::vector<uint8_t> _pending;
+        std::size_t _dropped = 0;
+        bool _running = false;
+    };
+
+    class CaptureReader {
+    public:
+        CaptureReader() = default;
+
+        ~CaptureReader();
+
+        // Returns false if the file could not be opened or is not a capture
+        bool open(const std::string &path);
+
+        // Reads the next record, returns false at the end of the file or on a truncated record
+        bool next(CaptureRecord &record);
+
+    private:
+        CaptureReader(const CaptureReader &) = delete;
+
+        CaptureReader &operator=(const CaptureReader &) = delete;
+
+        std::FILE *_file = nullptr;
+    };
+
+    // Monotonic time used for the records
+    uint64_t captureTime();
+}
@@ -0,0 +1,176 @@
+#include "config.h"
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace rb {
+    namespace detail {
+
+        namespace {
+            std::string trim(const std::string &str) {
+                auto begin = str.find_first_not_of(" \t\r");
+                if (begin == std::string::npos) return "";
+                auto end = str.find_last_not_of(" \t\r");
+                return str.substr(begin, end - begin + 1);
+            }
+
+            ConfigValue parseValue(const std::string &str) {
+                ConfigValue value;
+                value.str = str;
+                if (!str.empty()) {
+                    char *end = nullptr;
+                    value.f = std::strtof(str.c_str(), &end);
+                    value.isNumber = end == str.c_str() + str.size();
+                    value.i = value.isNumber ? static_cast<int>(value.f) : 0;
+                    if (!value.isNumber) value.f = 0.0f;
+                }
+                return value;
+            }
+
+            bool parseFile(const std::string &path, std::unordered_map<std::string, ConfigValue> &values) {
+                std::ifstream in(path);
+                if (in.fail()) return false;
+                for (std::string line; std::getline(in, line);) {
+                    line = trim(line);
+                    if (line.empty() || line[0] == '#') continue;
+                    auto pos = line.find('=');
+                    if (pos == std::string::npos) continue;
+                    values[trim(line.substr(0, pos))] = parseValue(trim(line.substr(pos + 1)));
+                }
+                return true;
+            }
+        }
+
+        ConfigSnapshot::ConfigSnapshot(std::unordered_map<std::string, ConfigValue> values, unsigned int version) :
+                _values(std::move(values)), _version(version) {}
+
+        const ConfigValue *ConfigSnapshot::find(const std::string &key) const {
+            auto it = this->_values.find(key);
+            return it == this->_values.end() ? nullptr : &it->second;
+        }
+
+        std::string ConfigSnapshot::getString(const std::string &key, const std::string &def) const {
+            auto value = this->find(key);
+            return value == nullptr ? def : value->str;
+        }
+
+        float ConfigSnapshot::getFloat(const std::string &key, float def) const {
+            auto value = this->find(key);
+            return value == nullptr || !value->isNumber ? def : value->f;
+        }
+
+        int ConfigSnapshot::getInt(const std::string &key, int def) const {
+            auto value = this->find(key);
+            return value == nullptr || !value->isNumber ? def : value->i;
+        }
+
+        unsigned int ConfigSnapshot::getVersion() const {
+            return this->_version;
+        }
+
+        Config &Config::instance() {
+            static Config config;
+            return config;
+        }
+
+        Config::Config() :
+                _snapshot(std::make_shared<ConfigSnapshot>(std::unordered_map<std::string, ConfigValue>(), 0)) {}
+
+        Config::~Config() {
+            this->stop();
+        }
+
+        bool Config::load(const std::string &path) {
+            if (this->_watching) return false;
+            this->_path = path;
+            return this->reload();
+        }
+
+        bool Config::reload() {
+            std::unordered_map<std::string, ConfigValue> values;
+            if (!parseFile(this->_path, values)) return false;
+
+            auto version = this->getSnapshot()->getVersion() + 1;
+            std::atomic_store(&this->_snapshot,
+                              std::shared_ptr<const ConfigSnapshot>(
+                                      std::make_shared<ConfigSnapshot>(std::move(values), version)));
+            return true;
+        }
+
+        bool Config::watch() {
+            if (this->_watching || this->_path.empty()) return false;
+
+            this->_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (this->_inotifyFd < 0) return false;
+
+            // Watch the directory: editors usually replace the file instead of writing it in place
+            auto slash = this->_path.find_last_of('/');
+            std::string directory = slash == std::string::npos ? "." : this->_path.substr(0, slash);
+            if (inotify_add_watch(this->_inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+                close(this->_inotifyFd);
+                this->_inotifyFd = -1;
+                return false;
+            }
+
+            this->_watching = true;
+            this->_watcher = std::thread(&Config::watcherMain, this);
+            return true;
+        }
+
+        void Config::stop() {
+            this->_watching = false;
+            if (this->_watcher.joinable()) this->_watcher.join();
+            if (this->_inotifyFd >= 0) {
+                close(this->_inotifyFd);
+                this->_inotifyFd = -1;
+            }
+        }
+
+        void Config::watcherMain() {
+            auto slash = this->_path.find_last_of('/');
+            std::string fileName = slash == std::string::npos ? this->_path : this->_path.substr(slash + 1);
+
+            alignas(inotify_event) char buffer[4096];
+            pollfd fd{this->_inotifyFd, POLLIN, 0};
+
+            while (this->_watching) {
+                if (poll(&fd, 1, 250) <= 0) continue;
+
+                bool changed = false;
+                ssize_t length;
+                while ((length = read(this->_inotifyFd, buffer, sizeof(buffer))) > 0) {
+                    for (char *ptr = buffer; ptr < buffer + length;) {
+                        auto event = reinterpret_cast<const inotify_event *>(ptr);
+                        if (event->len > 0 && fileName == event->name) {
+                            changed = true;
+                        }
+                        ptr += sizeof(inotify_event) + event->len;
+                    }
+                }
+
+                if (changed) {
+                    this->reload();
+                }
+            }
+        }
+
+        std::shared_ptr<const ConfigSnapshot> Config::getSnapshot() const {
+            return std::atomic_load(&this->_snapshot);
+        }
+
+        std::string Config::getString(const std::string &key, const std::string &def) const {
+            return this->getSnapshot()->getString(key, def);
+        }
+
+        float Config::getFloat(const std::string &key, float def) const {
+            return this->getSnapshot()->getFloat(key, def);
+        }
+
+        int Config::getInt(const std::string &key, int def) const {
+            return this->getSnapshot()->getInt(key, def);
+        }
+    }
+}
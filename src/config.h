@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace rb {
+    namespace detail {
+
+        /*
+         * Value of a config key, parsed once when the file is loaded
+         */
+        struct ConfigValue {
+            std::string str;
+            float f = 0.0f;
+            int i = 0;
+            bool isNumber = false;
+        };
+
+        /*
+         * Immutable state of the config file. A new snapshot is published on every reload,
+         * readers keep the old one alive for as long as they hold it.
+         */
+        class ConfigSnapshot {
+        public:
+            ConfigSnapshot(std::unordered_map<std::string, ConfigValue> values, unsigned int version);
+
+            const ConfigValue *find(const std::string &key) const;
+
+            std::string getString(const std::string &key, const std::string &def = "") const;
+
+            float getFloat(const std::string &key, float def = 0.0f) const;
+
+            int getInt(const std::string &key, int def = 0) const;
+
+            unsigned int getVersion() const;
+
+        private:
+            std::unordered_map<std::string, ConfigValue> _values;
+            unsigned int _version;
+        };
+
+        class Config {
+        public:
+            static Config &instance();
+
+            ~Config();
+
+            // Reads and parses the file, returns false if it could not be opened.
+            // The path can not be changed while the watcher is running.
+            bool load(const std::string &path);
+
+            // Starts the inotify watcher which reloads the file whenever it is written
+            bool watch();
+
+            void stop();
+
+            std::shared_ptr<const ConfigSnapshot> getSnapshot() const;
+
+            std::string getString(const std::string &key, const std::string &def = "") const;
+
+            float getFloat(const std::string &key, float def = 0.0f) const;
+
+            int getInt(const std::string &key, int def = 0) const;
+
+        private:
+            Config();
+
+            Config(const Config &) = delete;
+
+            Config &operator=(const Config &) = delete;
+
+            bool reload();
+
+            void watcherMain();
+
+            std::string _path;
+            std::shared_ptr<const ConfigSnapshot> _snapshot;
+            std::thread _watcher;
+            std::atomic<bool> _watching{false};
+            int _inotifyFd = -1;
+        };
+    }
+}
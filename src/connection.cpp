@@ -1,8 +1,8 @@
-#include <utility>
-
+#include <algorithm>
 #include <utility>
 
 #include "connection.h"
+#include "log.h"
 
 namespace rb {
 
@@ -11,18 +11,18 @@ namespace rb {
     BtConnection::BtConnection(boost::shared_ptr<Hive> hive) : Connection(std::move(hive)) {}
 
     void BtConnection::OnAccept(const std::string &addr, uint8_t channel) {
-        global_stream_lock.lock();
-        std::cout << "[OnAccept] " << addr << ":" << channel << "\n";
-        global_stream_lock.unlock();
+        RB_LOG_INFO("Accepted {} channel {}", addr, channel);
+        _unconsumed = 0;
+        if (_capture) _capture->write(_stream, CaptureKind::Connected);
 
         // Start the next receive
         Recv();
     }
 
     void BtConnection::OnConnect(const std::string &addr, uint8_t channel) {
-        global_stream_lock.lock();
-        std::cout << "[OnConnect] " << addr << ":" << channel << "\n";
-        global_stream_lock.unlock();
+        RB_LOG_INFO("Connected to {} channel {}", addr, channel);
+        _unconsumed = 0;
+        if (_capture) _capture->write(_stream, CaptureKind::Connected);
 
         runCbEvent(StatusConnection::Connected, {});
         // Start the next receive
@@ -30,46 +30,40 @@ namespace rb {
     }
 
     void BtConnection::OnSend(const std::vector<uint8_t> &buffer) {
-        global_stream_lock.lock();
-        std::cout << "[OnSend] " << buffer.size() << " bytes\n";
-        for(size_t x=0; x<buffer.size(); x++) {
-
-            std::cout << (char)buffer[x];
-            if((x + 1) % 16 == 0)
-                std::cout << "\n";
-        }
-        std::cout << "\n";
-        global_stream_lock.unlock();
+        RB_LOG_TRACE("Sent {} bytes: {}", buffer.size(), detail::LogBytes{buffer.data(), buffer.size()});
+        if (_capture) _capture->write(_stream, CaptureKind::Sent, buffer.data(), buffer.size());
     }
 
-    void BtConnection::OnRecv(std::vector<uint8_t> &buffer) {
-        global_stream_lock.lock();
-        std::cout << "[OnRecv] " << buffer.size() << " bytes\n";
-        for(size_t x=0; x<buffer.size(); x++) {
+    std::size_t BtConnection::OnRecv(const uint8_t *data, std::size_t size) {
+        RB_LOG_TRACE("Received {} bytes: {}", size, detail::LogBytes{data, size});
+        if (_capture && size > _unconsumed) {
+            _capture->write(_stream, CaptureKind::Received, data + _unconsumed, size - _unconsumed);
+        }
 
-            std::cout << (char)buffer[x];
-            if((x + 1) % 16 == 0)
-                std::cout << "\n";
+        std::size_t consumed = size;
+        if (!_framed) {
+            runCbEvent(StatusConnection::Recived, BufferView{data, size});
+        } else {
+            // A frame split between reads stays in the receive buffer until the rest arrives
+            consumed = _parser.parse(data, size, [this](const FrameView &frame) {
+                runCbFrame(frame);
+            });
         }
-        std::cout << "\n";
-        global_stream_lock.unlock();
 
-        runCbEvent(StatusConnection::Recived, buffer);
+        _unconsumed = size - std::min(consumed, size);
 
         // Start the next receive
         Recv();
+        return consumed;
     }
 
     void BtConnection::OnTimer(const boost::posix_time::time_duration &delta) {
-        global_stream_lock.lock();
-        std::cout << "[OnTimer] " << delta << std::endl;
-        global_stream_lock.unlock();
+        RB_LOG_TRACE("Timer {} ms", delta.total_milliseconds());
     }
 
     void BtConnection::OnError(const boost::system::error_code &error) {
-        global_stream_lock.lock();
-        std::cout << "[OnError] " << error.message() << "\n";
-        global_stream_lock.unlock();
+        RB_LOG_INFO("Connection closed: {}", error.message());
+        if (_capture) _capture->write(_stream, CaptureKind::Closed);
         runCbEvent(StatusConnection::Closed, {});
     }
 
@@ -77,7 +71,26 @@ namespace rb {
         this->_cbEvent = std::move(cbEvent);
     }
 
-    void BtConnection::runCbEvent(StatusConnection status, const std::vector<uint8_t> buffer) {
+    void BtConnection::setCapture(std::shared_ptr<CaptureWriter> capture, uint8_t stream) {
+        this->_capture = std::move(capture);
+        this->_stream = stream;
+    }
+
+    void BtConnection::onFrame(BtFrameEvent cbFrame) {
+        this->_cbFrame = std::move(cbFrame);
+    }
+
+    void BtConnection::setFramed(bool framed) {
+        this->_framed = framed;
+    }
+
+    void BtConnection::runCbFrame(const FrameView &frame) {
+        if(_cbFrame) {
+            _cbFrame(frame);
+        }
+    }
+
+    void BtConnection::runCbEvent(StatusConnection status, BufferView buffer) {
         if(_cbEvent) {
             _cbEvent(status, buffer);
         }
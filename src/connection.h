@@ -1,16 +1,17 @@
 #pragma once
 
 #include "../libext/asio_bluetooth/wrapper.h"
-#include <boost/thread/mutex.hpp>
-#include <boost/thread/thread.hpp>
-#include <termios.h>
-#include <unistd.h>
-#include <stdio.h>
+#include <atomic>
+#include <memory>
+#include "capture.h"
 #include "data.h"
+#include "protocol.h"
 
 namespace rb {
 
-    using  BtConnectionEvent =  std::function<void(StatusConnection, const std::vector<uint8_t>)>;
+    using  BtConnectionEvent =  std::function<void(StatusConnection, BufferView)>;
+
+    using  BtFrameEvent =  std::function<void(const FrameView &)>;
 
     class BtConnection : public Connection {
     public:
@@ -20,8 +21,18 @@ namespace rb {
 
         void onEvent(BtConnectionEvent cbEvent);
 
+        void onFrame(BtFrameEvent cbFrame);
+
+        // Framed connections deliver parsed frames to onFrame, raw ones deliver every read to onEvent
+        void setFramed(bool framed);
+
+        // Records the traffic of the connection as the stream, must be set before connecting
+        void setCapture(std::shared_ptr<CaptureWriter> capture, uint8_t stream);
+
     protected:
-        virtual void runCbEvent(StatusConnection status, const std::vector<uint8_t> buffer);
+        virtual void runCbEvent(StatusConnection status, BufferView buffer);
+
+        virtual void runCbFrame(const FrameView &frame);
 
     private:
         void OnAccept(const std::string &addr, uint8_t channel) override;
@@ -30,14 +41,20 @@ namespace rb {
 
         void OnSend(const std::vector<uint8_t> &buffer) override;
 
-        void OnRecv(std::vector<uint8_t> &buffer) override;
+        std::size_t OnRecv(const uint8_t *data, std::size_t size) override;
 
         void OnTimer(const boost::posix_time::time_duration &delta) override;
 
         void OnError(const boost::system::error_code &error) override;
 
     private:
-        boost::mutex global_stream_lock;
         BtConnectionEvent _cbEvent;
+        BtFrameEvent _cbFrame;
+        std::atomic<bool> _framed{false};
+        FrameParser _parser;
+        std::shared_ptr<CaptureWriter> _capture;
+        uint8_t _stream = 0;
+        // Bytes the last OnRecv left in the receive buffer, they come again at the front of the next one
+        std::size_t _unconsumed = 0;
     };
 }
\ No newline at end of file
@@ -1,11 +1,14 @@
+#include <algorithm>
 #include <thread>
 #include <atomic>
 #include <mutex>
 #include <functional>
 #include <iostream>
+#include <stdexcept>
 #include "core.h"
 #include "data.h"
 #include "queue.h"
+#include "task.h"
 #include "../libext/asio_bluetooth/wrapper.h"
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
@@ -14,18 +17,57 @@
 #include <unistd.h>
 #include <stdio.h>
 #include "connection.h"
+#include "config.h"
+#include "log.h"
+#include "metrics.h"
 
 namespace rb {
 
-    inline void updateStateData(const StateData *bsrc, StateData *bdst) {
-        bdst->statusConnection = bsrc->statusConnection;
-        bdst->statusControl = bsrc->statusControl;
-        bdst->positionActive = bsrc->positionActive;
-        bdst->message = bsrc->message;
+    // Fields of RobotState which are published separately, a new message does not copy the rest
+    enum RobotField {
+        FIELD_CONTROL,
+        FIELD_CONNECTION,
+        FIELD_POSITION,
+        FIELD_MESSAGE,
+        FIELD_COUNT
+    };
+
+    // Stamp of the change each field of a robot holds. Every change gets a new stamp, so equal
+    // stamps mean equal values and a reader copies only the fields whose stamp differs.
+    typedef std::array<std::uint32_t, FIELD_COUNT> FieldStamps;
+
+    inline bool fieldEquals(const RobotState &a, const RobotState &b, int field) {
+        switch (field) {
+            case FIELD_CONTROL:
+                return a.statusControl == b.statusControl;
+            case FIELD_CONNECTION:
+                return a.statusConnection == b.statusConnection;
+            case FIELD_POSITION:
+                return a.positionActive == b.positionActive;
+            default:
+                return a.message == b.message;
+        }
+    }
+
+    inline void copyField(const RobotState &src, RobotState &dst, int field) {
+        switch (field) {
+            case FIELD_CONTROL:
+                dst.statusControl = src.statusControl;
+                break;
+            case FIELD_CONNECTION:
+                dst.statusConnection = src.statusConnection;
+                break;
+            case FIELD_POSITION:
+                dst.positionActive = src.positionActive;
+                break;
+            default:
+                dst.message = src.message;
+                break;
+        }
     }
 
     struct Core::Data {
-        Data() : hive(new Hive()), connection(new BtConnection(hive)) {};
+        Data() : hive(new Hive()) {};
 
         ~Data() {
             free();
@@ -41,71 +83,233 @@ namespace rb {
 
         }
 
-        enum BufferId {
-            BUFFER_UI,
-            BUFFER_CACHED,
-            BUFFER_ACTIVE,
+        // One buffer of the triple buffer between the core and the UI thread
+        struct StateSlot {
+            StateData state;
+            std::vector<FieldStamps> stamps;
         };
 
+        // Low bits of `middle` are the index of the slot, the flag marks a slot the UI has not taken
+        static const std::uint8_t SLOT_INDEX = 0x3;
+        static const std::uint8_t SLOT_FRESH = 0x4;
+
+        // Connection and mission of one robot, its state is active.robots[i]
+        struct Robot {
+            explicit Robot(boost::shared_ptr<Hive> hive) : connection(new BtConnection(std::move(hive))) {}
+
+            boost::shared_ptr<BtConnection> connection;
+
+            // Snapshot of the route being played, indexed by missionSent and missionAcked. Up to
+            // `window` commands are sent ahead of the acknowledgements, a window of 1 is stop-and-wait.
+            RouteSnapshot mission;
+            std::size_t missionSent = 0;
+            std::size_t missionAcked = 0;
+            std::size_t window = 1;
+
+            // Send time of the commands in flight by sequence number, for the round trip histogram
+            std::array<std::uint64_t, 256> sentAt{};
+
+            std::size_t missionSize() const {
+                return mission ? mission->commands.size() : 0;
+            }
+
+            // Framed protocol, otherwise the raw stop-and-wait protocol of the old firmware
+            bool framed = false;
+        };
+
+        RobotState &state(std::size_t robot) {
+            return active.robots[robot];
+        }
+
+        // All robots share the hive, so one thread serves every connection
         boost::shared_ptr<Hive> hive;
 
-        boost::shared_ptr<BtConnection> connection;
+        // Traffic of all robots, each one is a stream of the capture
+        std::shared_ptr<CaptureWriter> capture;
+
+        std::vector<Robot> robots;
 
         std::thread workerMain;
         std::thread workerConnect;
 
+        // Core thread only
         bool needRecache = false;
-        bool cacheUpdated = false;
         std::atomic<bool> isRunning{};
 
-        mutable std::mutex mutexStateData;
-
         std::weak_ptr<StateInput> stateInput;
-        std::array<std::shared_ptr<StateData>, 3> stateData;
 
-        RingBuffer<std::function<void()>, 256> inputQueue;
+        // State the core works on, only the core thread touches it
+        StateData active;
+        std::uint32_t lastStamp = 0;
+
+        // Triple buffer: the core fills slots[back] and swaps it with `middle`, the UI swaps
+        // `middle` with slots[front]. Neither side waits for the other, the UI always gets the
+        // latest complete state and skips the ones it was too slow for.
+        std::array<StateSlot, 3> slots;
+        std::atomic<std::uint8_t> middle{1};
+        std::uint8_t back = 0;
+        std::uint8_t front = 2;
+
+        // State the editor reads, the UI thread updates it from slots[front]
+        std::shared_ptr<StateData> ui;
+        std::vector<FieldStamps> uiStamps;
+
+        // Only for waitUpdate, the core takes the mutex only while the UI sleeps on it
+        std::atomic<bool> uiWaiting{false};
+        std::mutex waitMutex;
+        std::condition_variable waitCondVar;
+
+        // Core thread. Copies the fields of the active state which changed into the back slot
+        // and publishes it.
+        void publish() {
+            auto &slot = slots[back];
+            for (std::size_t robot = 0; robot < active.robots.size(); ++robot) {
+                for (int field = 0; field < FIELD_COUNT; ++field) {
+                    if (fieldEquals(active.robots[robot], slot.state.robots[robot], field)) continue;
+                    copyField(active.robots[robot], slot.state.robots[robot], field);
+                    slot.stamps[robot][field] = ++lastStamp;
+                }
+            }
+
+            back = middle.exchange(static_cast<std::uint8_t>(back | SLOT_FRESH)) & SLOT_INDEX;
+
+            if (uiWaiting.load()) {
+                // The UI checks for a fresh slot under the mutex before it sleeps
+                { std::lock_guard<std::mutex> lock(waitMutex); }
+                waitCondVar.notify_all();
+            }
+        }
 
+        // Captures of the tasks are stored in the queue, posting an event never allocates
+        typedef InlineTask<64> Task;
 
-        std::mutex m;
-        std::condition_variable cond_var;
-        bool notified = false;
+        struct Event {
+            std::uint64_t queuedAt = 0;
+            Task task;
+        };
+
+        // Filled by the render and hive threads, drained by workerMain or on the strand
+        MpscQueue<Event, 256> inputQueue;
+
+        // core_executor=strand: the queue is drained on a strand of the hive instead of workerMain,
+        // so an acknowledgement is handled on the hive thread which received it
+        std::unique_ptr<boost::asio::io_context::strand> strand;
+        std::function<void()> drain;
+        std::atomic<bool> drainScheduled{false};
+
+        void post(Task task) {
+            Event event;
+            event.queuedAt = detail::Metrics::now();
+            event.task = std::move(task);
+            if (!inputQueue.push(std::move(event))) {
+                RB_LOG_WARN("Core input queue is full, event dropped");
+                return;
+            }
+            // dispatch runs the drain right here when called from a hive thread and the strand is free
+            if (strand && !drainScheduled.exchange(true)) strand->dispatch(drain);
+        }
 
     };
 
+    const int Core::MAX_ROBOTS;
+    const std::uint8_t Core::Data::SLOT_INDEX;
+    const std::uint8_t Core::Data::SLOT_FRESH;
+
     Core::Core() : _data(new Data()) {
-        _data->stateData[Data::BUFFER_UI] = std::make_shared<StateData>();
-        _data->stateData[Data::BUFFER_CACHED] = std::make_shared<StateData>();
-        _data->stateData[Data::BUFFER_ACTIVE] = std::make_shared<StateData>();
+        // Failures of the wrapper also reach BtConnection::OnError, this adds where they happened
+        SetLogHandler([](const std::string &message) { RB_LOG_WARN("{}", message); });
+
+        const int fleetSize = std::max(1, std::min(Core::MAX_ROBOTS, detail::Config::instance().getInt("fleet_size", 1)));
+        for (int i = 0; i < fleetSize; ++i) {
+            _data->robots.emplace_back(_data->hive);
+        }
+
+        const auto capturePath = detail::Config::instance().getString("capture_file");
+        if (!capturePath.empty()) {
+            _data->capture = std::make_shared<CaptureWriter>();
+            if (!_data->capture->open(capturePath)) {
+                RB_LOG_WARN("Failed to open the capture file {}", capturePath);
+                _data->capture.reset();
+            }
+        }
+        for (std::size_t robot = 0; robot < _data->robots.size(); ++robot) {
+            _data->robots[robot].connection->setCapture(_data->capture, static_cast<uint8_t>(robot));
+        }
+
+        _data->active.robots.resize(_data->robots.size());
+        for (auto &slot : _data->slots) {
+            slot.state.robots.resize(_data->robots.size());
+            slot.stamps.resize(_data->robots.size(), FieldStamps{});
+        }
+        _data->ui = std::make_shared<StateData>();
+        _data->ui->robots.resize(_data->robots.size());
+        _data->uiStamps.resize(_data->robots.size(), FieldStamps{});
     }
 
     Core::~Core() {
         if (_data->workerMain.joinable()) _data->workerMain.join();
+        if (_data->workerConnect.joinable()) {
+            _data->hive->Stop();
+            _data->workerConnect.join();
+        }
     }
 
     void Core::init() {
         _data->isRunning = true;
 
-        _data->workerMain = std::thread(&Core::main, this);
+        // "thread" runs the core on workerMain, "strand" on the hive next to the connections
+        if (detail::Config::instance().getString("core_executor", "thread") == "strand") {
+            _data->strand.reset(new boost::asio::io_context::strand(_data->hive->GetService()));
+            _data->drain = [this] { this->drain(); };
+        } else {
+            _data->workerMain = std::thread(&Core::main, this);
+        }
 
-        _data->connection->onEvent([this](StatusConnection status, const std::vector<uint8_t> buffer) {
-            this->connectionCbEvent(status, buffer);
-        });
+        for (std::size_t robot = 0; robot < _data->robots.size(); ++robot) {
+            auto &connection = _data->robots[robot].connection;
 
-        _data->workerConnect = std::thread([&] { _data->hive->Run(); });
-    }
+            connection->onEvent([this, robot](StatusConnection status, BufferView buffer) {
+                this->connectionCbEvent(robot, status, buffer);
+            });
 
-    void Core::update() {
+            connection->onFrame([this, robot](const FrameView &frame) {
+                this->connectionCbFrame(robot, frame);
+            });
+        }
+
+        // 0 runs a thread per core, robots are spread over the threads and each one stays on its strand
+        int threads = detail::Config::instance().getInt("hive_threads", 1);
+        if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        _data->workerConnect = std::thread([this, threads] { _data->hive->Run(static_cast<uint32_t>(threads)); });
+    }
 
-        if (!_data->cacheUpdated) return;
+    bool Core::update() {
 
-        std::lock_guard<std::mutex> lock(_data->mutexStateData);
+        if (!(_data->middle.load(std::memory_order_acquire) & Data::SLOT_FRESH)) return false;
 
-        auto &bsrc = _data->stateData[Data::BUFFER_CACHED];
-        auto &bdst = _data->stateData[Data::BUFFER_UI];
+        _data->front = _data->middle.exchange(_data->front) & Data::SLOT_INDEX;
 
-        updateStateData(bsrc.get(), bdst.get());
+        const auto &slot = _data->slots[_data->front];
+        auto &ui = *_data->ui;
+        for (std::size_t robot = 0; robot < ui.robots.size(); ++robot) {
+            auto &stamps = _data->uiStamps[robot];
+            for (int field = 0; field < FIELD_COUNT; ++field) {
+                if (stamps[field] == slot.stamps[robot][field]) continue;
+                copyField(slot.state.robots[robot], ui.robots[robot], field);
+                stamps[field] = slot.stamps[robot][field];
+            }
+        }
+        return true;
+    }
 
-        _data->cacheUpdated = false;
+    bool Core::waitUpdate(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(_data->waitMutex);
+        _data->uiWaiting = true;
+        bool fresh = _data->waitCondVar.wait_for(lock, timeout, [this] {
+            return (_data->middle.load() & Data::SLOT_FRESH) != 0;
+        });
+        _data->uiWaiting = false;
+        return fresh;
     }
 
     void Core::exit() {
@@ -113,28 +317,45 @@ namespace rb {
     }
 
     std::weak_ptr<StateData> Core::getStateData() const {
-        return _data->stateData[Data::BUFFER_UI];
+        return _data->ui;
     }
 
     void Core::setStateInput(std::weak_ptr<StateInput> stateInput) {
         _data->stateInput = stateInput;
     }
 
+    std::size_t Core::getRobotCount() const {
+        return _data->robots.size();
+    }
+
     void Core::notifyEvent(Core::Event event) {
+        std::size_t robot = 0;
+        {
+            auto inp = _data->stateInput.lock();
+
+            if (inp == nullptr) return;
+
+            robot = static_cast<std::size_t>(std::max(0, inp->robot));
+        }
+        if (robot >= _data->robots.size()) return;
+
+        this->notifyEvent(event, robot);
+    }
+
+    void Core::notifyEvent(Core::Event event, std::size_t robot) {
 
         auto inp = _data->stateInput.lock();
 
         if (inp == nullptr) return;
 
-        std::unique_lock<std::mutex> lock(_data->m);
-
         switch (event) {
             case Core::Event::Close: {
-                _data->inputQueue.push([this]() {
+                _data->post([this]() {
 
                     _data->hive->Stop();
 
-                    if (_data->workerConnect.joinable()) _data->workerConnect.join();
+                    // On the strand this is a hive thread, the destructor joins it instead
+                    if (!_data->strand && _data->workerConnect.joinable()) _data->workerConnect.join();
 
                     _data->isRunning = false;
                 });
@@ -145,144 +366,220 @@ namespace rb {
                 auto macAddress = inp->macAddress;
                 auto chanel = inp->chanel;
 
-                _data->inputQueue.push([this, macAddress, chanel]() {
+                _data->post([this, robot, macAddress, chanel]() {
                     _data->needRecache = true;
-                    _data->connection->Connect(macAddress, chanel);
+                    auto &r = _data->robots[robot];
+                    bool framed = detail::Config::instance().getString("command_protocol", "raw") == "framed";
+                    // "bluetooth" uses the address from the editor, otherwise an endpoint like
+                    // "tcp:127.0.0.1:5000" or "unix:/tmp/rembot.sock" for running without an adapter
+                    auto transport = detail::Config::instance().getString("transport", "bluetooth");
+
+                    StreamEndpoint endpoint;
+                    try {
+                        endpoint = transport == "bluetooth" ? MakeBluetoothEndpoint(macAddress, chanel)
+                                                            : ParseEndpoint(transport);
+                    } catch (const std::invalid_argument &e) {
+                        _data->state(robot).message = e.what();
+                        return;
+                    }
 
-                    _data->stateData[Data::BUFFER_ACTIVE]->statusConnection = StatusConnection::Connecting;
-                    _data->stateData[Data::BUFFER_ACTIVE]->message = "Connecting...";
+                    r.framed = framed;
+                    r.connection->setFramed(framed);
+                    r.connection->Connect(endpoint);
+
+                    _data->state(robot).statusConnection = StatusConnection::Connecting;
+                    _data->state(robot).message = "Connecting...";
                 });
             }
                 break;
             case Core::Event::Connected: {
-                _data->inputQueue.push([this]() {
+                _data->post([this, robot]() {
                     _data->needRecache = true;
-                    _data->stateData[Data::BUFFER_ACTIVE]->statusConnection = StatusConnection::Connected;
-                    _data->stateData[Data::BUFFER_ACTIVE]->message = "Connected";
+                    _data->state(robot).statusConnection = StatusConnection::Connected;
+                    _data->state(robot).message = "Connected";
                 });
             }
                 break;
             case Core::Event::Disconnected: {
-                _data->inputQueue.push([this]() {
+                _data->post([this, robot]() {
                     _data->needRecache = true;
-                    _data->stateData[Data::BUFFER_ACTIVE]->statusConnection = StatusConnection::Closed;
-                    _data->stateData[Data::BUFFER_ACTIVE]->statusControl = StatusControl::Stop;
-                    _data->stateData[Data::BUFFER_ACTIVE]->message = "Disconnected";
+                    _data->state(robot).statusConnection = StatusConnection::Closed;
+                    _data->state(robot).statusControl = StatusControl::Stop;
+                    _data->state(robot).message = "Disconnected";
                 });
             }
                 break;
             case Core::Event::Disconnect: {
-                _data->inputQueue.push([this]() {
+                _data->post([this, robot]() {
                     _data->needRecache = true;
-                    _data->connection->Disconnect();
-                    _data->stateData[Data::BUFFER_ACTIVE]->statusConnection = StatusConnection::Closing;
-                    _data->stateData[Data::BUFFER_ACTIVE]->message = "Disconnecting...";
+                    _data->robots[robot].connection->Disconnect();
+                    _data->state(robot).statusConnection = StatusConnection::Closing;
+                    _data->state(robot).message = "Disconnecting...";
                 });
             }
                 break;
             case Core::Event::Play: {
-                // Отправляем первую команду роботу из списка
-                auto command = inp->commands.at(0);
+                // Отправляем первые команды роботу из списка
+                auto route = inp->route.current();
+                if (route == nullptr) break;
+                // Sequence numbers are one byte, so at most half of their range may be in flight
+                int window = std::max(1, std::min(128, detail::Config::instance().getInt("command_window", 1)));
 
-                _data->inputQueue.push([this, command]() {
+                _data->post([this, robot, route, window]() {
                     _data->needRecache = true;
-                    _data->stateData[Data::BUFFER_ACTIVE]->positionActive = 0;
-                    _data->stateData[Data::BUFFER_ACTIVE]->statusControl = StatusControl::Play;
-                    _data->stateData[Data::BUFFER_ACTIVE]->message = "Play";
-                    _data->connection->Send(
-                            {(uint8_t) command.direction, (uint8_t) command.length, (uint8_t) command.size});
+                    auto &r = _data->robots[robot];
+                    RB_LOG_INFO("Robot {} plays route version {}, {} commands", robot, route->version, route->commands.size());
+                    r.mission = route;
+                    r.missionSent = 0;
+                    r.missionAcked = 0;
+                    // The raw protocol has no sequence numbers
+                    r.window = r.framed ? static_cast<std::size_t>(window) : 1;
+                    _data->state(robot).positionActive = 0;
+                    _data->state(robot).statusControl = StatusControl::Play;
+                    _data->state(robot).message = "Play";
+                    streamCommands(robot);
                 });
             }
                 break;
             case Core::Event::Stop: {
                 // Останавливаем робота и зануляем значения
-                _data->inputQueue.push([this]() {
+                _data->post([this, robot]() {
                     _data->needRecache = true;
-                    _data->stateData[Data::BUFFER_ACTIVE]->positionActive = 0;
-                    _data->stateData[Data::BUFFER_ACTIVE]->statusControl = StatusControl::Stop;
-                    _data->stateData[Data::BUFFER_ACTIVE]->message = "Stop";
-                    _data->connection->Send({(uint8_t) StatusControl::Stop});
+                    auto &r = _data->robots[robot];
+                    r.mission.reset();
+                    r.missionSent = 0;
+                    r.missionAcked = 0;
+                    _data->state(robot).positionActive = 0;
+                    _data->state(robot).statusControl = StatusControl::Stop;
+                    _data->state(robot).message = "Stop";
+                    if (r.framed) {
+                        r.connection->Send(encodeFrame(FrameType::Stop, 0));
+                    } else {
+                        r.connection->Send({(uint8_t) StatusControl::Stop});
+                    }
                 });
             }
                 break;
             case Core::Event::Next: {
-                // Отправляем следующую команду и отрисовываем
-                auto commands = inp->commands;
-                _data->inputQueue.push([this, commands]() {
-                    _data->needRecache = true;
-                    auto newPositionActive = _data->stateData[Data::BUFFER_ACTIVE]->positionActive + 1;
-
-                    if (newPositionActive < commands.size()) {
-                        auto command = commands.at(newPositionActive);
-
-                        _data->needRecache = true;
-                        _data->stateData[Data::BUFFER_ACTIVE]->positionActive = newPositionActive;
-                        _data->stateData[Data::BUFFER_ACTIVE]->message = ("Point " + std::to_string(newPositionActive));
-                        _data->connection->Send(
-                                {(uint8_t) command.direction, (uint8_t) command.length, (uint8_t) command.size});
-                    } else {
-                        _data->stateData[Data::BUFFER_ACTIVE]->positionActive = newPositionActive-1;
-                        _data->stateData[Data::BUFFER_ACTIVE]->statusControl = StatusControl::Stop;
-                        _data->stateData[Data::BUFFER_ACTIVE]->message = "Finish";
-                    }
+                // Робот выполнил команду, отправляем следующие
+                _data->post([this, robot]() {
+                    acknowledge(robot, -1);
                 });
             }
                 break;
             default:
                 break;
         }
-        _data->notified = true;
-        _data->cond_var.notify_one();
     }
 
-    void Core::input() {
-        {
-            auto inp = _data->stateInput.lock();
+    void Core::notifyAck(std::size_t robot, uint8_t seq) {
+        _data->post([this, robot, seq]() {
+            acknowledge(robot, seq);
+        });
+    }
 
-            if (inp == nullptr) return;
+    void Core::acknowledge(std::size_t robot, int seq) {
+        auto &r = _data->robots[robot];
+        auto &state = _data->state(robot);
+        if (state.statusControl != StatusControl::Play) return;
+
+        const std::size_t inFlight = r.missionSent - r.missionAcked;
+        if (inFlight == 0) return;
+
+        std::size_t count = 1;
+        if (seq >= 0) {
+            // Distance from the oldest command in flight, acknowledgements of older commands are stale
+            count = static_cast<uint8_t>(seq - static_cast<uint8_t>(r.missionAcked)) + 1u;
+            if (count > inFlight) return;
+        }
+        auto &metrics = detail::Metrics::instance();
+        const auto now = detail::Metrics::now();
+        for (std::size_t i = r.missionAcked; i < r.missionAcked + count; ++i) {
+            metrics.commandRtt.record(now - r.sentAt[i & 0xFF]);
         }
 
-        while (_data->inputQueue.size() > 0) {
-            _data->inputQueue.pop()();
+        r.missionAcked += count;
+        _data->needRecache = true;
+
+        if (r.missionAcked >= r.missionSize()) {
+            state.positionActive = static_cast<int>(r.missionSize()) - 1;
+            state.statusControl = StatusControl::Stop;
+            state.message = "Finish";
+            r.mission.reset();
+            r.missionSent = 0;
+            r.missionAcked = 0;
+            return;
         }
+
+        state.positionActive = static_cast<int>(r.missionAcked);
+        state.message = ("Point " + std::to_string(r.missionAcked));
+        streamCommands(robot);
     }
 
-    void Core::main() {
-        auto data = _data->stateData[Data::BUFFER_ACTIVE];
+    void Core::streamCommands(std::size_t robot) {
+        auto &r = _data->robots[robot];
+        while (r.missionSent < r.missionSize() && r.missionSent - r.missionAcked < r.window) {
+            const auto &command = r.mission->commands[r.missionSent];
+            const uint8_t payload[] = {(uint8_t) command.direction, (uint8_t) command.length, (uint8_t) command.size};
+            auto buffer = r.connection->AcquireBuffer();
+            if (r.framed) {
+                encodeFrame(buffer, FrameType::Command, (uint8_t) r.missionSent, payload, sizeof(payload));
+            } else {
+                buffer.assign(payload, payload + sizeof(payload));
+            }
+            r.connection->Send(std::move(buffer));
+            r.sentAt[r.missionSent & 0xFF] = detail::Metrics::now();
+            ++r.missionSent;
+        }
+    }
 
-        while (_data->isRunning) {
-            std::unique_lock<std::mutex> lock(_data->m);
+    void Core::input() {
+        // Tasks copied what they need from the input state when they were queued
+        auto &metrics = detail::Metrics::instance();
+        const auto start = detail::Metrics::now();
+        bool ran = false;
+        Data::Event event;
+        while (_data->inputQueue.tryPop(event)) {
+            metrics.queueWait.record(detail::Metrics::now() - event.queuedAt);
+            event.task();
+            ran = true;
+        }
+        if (ran) metrics.coreInput.record(detail::Metrics::now() - start);
+    }
 
-            while (!_data->notified)
-                _data->cond_var.wait(lock);
+    void Core::main() {
+        while (_data->isRunning) {
+            _data->inputQueue.wait();
 
             input();
 
             cache();
-
-            _data->notified = false;
         }
     }
 
-    void Core::cache() {
-        if (!_data->needRecache) return;
+    void Core::drain() {
+        // Cleared first, an event queued from here on schedules the next drain. Pairs with the
+        // fence in MpscQueue::push, either this drain sees the event or the producer sees false.
+        _data->drainScheduled = false;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
 
-        std::lock_guard<std::mutex> lock(_data->mutexStateData);
+        input();
 
-        auto &bsrc = _data->stateData[Data::BUFFER_ACTIVE];
-        auto &bdst = _data->stateData[Data::BUFFER_CACHED];
+        cache();
+    }
 
-        updateStateData(bsrc.get(), bdst.get());
+    void Core::cache() {
+        if (!_data->needRecache) return;
 
-        _data->cacheUpdated = true;
+        _data->publish();
         _data->needRecache = false;
     }
 
-    void Core::connectionCbEvent(StatusConnection status, const std::vector<uint8_t> buffer) {
+    void Core::connectionCbEvent(std::size_t robot, StatusConnection status, BufferView buffer) {
 
         switch (status) {
             case StatusConnection::Closed: {
-                this->notifyEvent(Core::Event::Disconnected);
+                this->notifyEvent(Core::Event::Disconnected, robot);
             }
                 break;
             case StatusConnection::Closing:
@@ -290,26 +587,26 @@ namespace rb {
             case StatusConnection::Connecting:
                 break;
             case StatusConnection::Connected: {
-                this->notifyEvent(Core::Event::Connected);
+                this->notifyEvent(Core::Event::Connected, robot);
             }
                 break;
             case StatusConnection::Recived: {
                 // Проверяем ответ и отправляем команду
 
                 if (buffer.empty()) {
-                    this->notifyEvent(Core::Event::Stop);
+                    this->notifyEvent(Core::Event::Stop, robot);
                     break;
                 }
 
                 switch (static_cast<StatusCommand>(buffer[0])) {
                     case StatusCommand::Ok :
-                        this->notifyEvent(Core::Event::Next);
+                        this->notifyEvent(Core::Event::Next, robot);
                         break;
                     case StatusCommand::No :
-                        this->notifyEvent(Core::Event::Stop);
+                        this->notifyEvent(Core::Event::Stop, robot);
                         break;
                     default:
-                        this->notifyEvent(Core::Event::Stop);
+                        this->notifyEvent(Core::Event::Stop, robot);
                         break;
                 }
 
@@ -318,6 +615,18 @@ namespace rb {
         }
     }
 
+    void Core::connectionCbFrame(std::size_t robot, const FrameView &frame) {
+        switch (frame.type) {
+            case FrameType::Ack:
+                this->notifyAck(robot, frame.seq);
+                break;
+            case FrameType::Nak:
+                this->notifyEvent(Core::Event::Stop, robot);
+                break;
+            default:
+                break;
+        }
+    }
 
 }
 
@@ -1,9 +1,12 @@
 #pragma once
 
 #include <memory>
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
+#include <cstdint>
 #include "data.h"
+#include "protocol.h"
 
 namespace rb {
 
@@ -12,13 +15,20 @@ namespace rb {
 
     class Core {
     public:
+        // Upper bound of the fleet_size config value
+        static const int MAX_ROBOTS = 64;
+
         Core();
         ~Core();
 
 
         void init();
 
-        void update();
+        // Publishes the latest state to the UI buffer, returns true if it changed
+        bool update();
+
+        // Blocks until the core has a new state to publish or the timeout expires
+        bool waitUpdate(std::chrono::milliseconds timeout);
 
         void exit();
 
@@ -26,6 +36,9 @@ namespace rb {
 
         void setStateInput(std::weak_ptr<StateInput> stateInput);
 
+        // Number of robots, fixed when the core is created
+        std::size_t getRobotCount() const;
+
         enum Event {
             Close,
             Connect,
@@ -37,15 +50,31 @@ namespace rb {
             Next
         };
 
+        // Event for the robot selected in the editor
         void notifyEvent(Event event);
 
-        void connectionCbEvent(StatusConnection status, const std::vector<uint8_t> buffer);
+        void notifyEvent(Event event, std::size_t robot);
+
+        void connectionCbEvent(std::size_t robot, StatusConnection status, BufferView buffer);
+
+        void connectionCbFrame(std::size_t robot, const FrameView &frame);
 
     private:
         void input();
         void main();
+        // Runs the queued events on the strand, the counterpart of main for core_executor=strand
+        void drain();
         void cache();
 
+        // Queues a cumulative acknowledgement of the command with the sequence number
+        void notifyAck(std::size_t robot, uint8_t seq);
+
+        // Marks commands as done, a negative seq acknowledges only the oldest command in flight
+        void acknowledge(std::size_t robot, int seq);
+
+        // Sends commands of the mission until the window is full
+        void streamCommands(std::size_t robot);
+
         struct Data;
         std::unique_ptr<Data> _data;
     };
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace rb {
@@ -18,6 +22,40 @@ namespace rb {
         Direction view;
     };
 
+    /*
+     * Compiled route. A published route is never changed, a new one gets the next version.
+     */
+    struct Route {
+        std::uint64_t version;
+        std::vector<Command> commands;
+    };
+
+    typedef std::shared_ptr<const Route> RouteSnapshot;
+
+    /*
+     * Latest route published by the editor. Readers take a snapshot and keep using it while
+     * a newer route is published, so a running mission does not change under the core.
+     */
+    class RoutePublisher {
+    public:
+        // Editor thread
+        void publish(std::vector<Command> commands) {
+            auto route = std::make_shared<Route>();
+            route->version = ++this->_version;
+            route->commands = std::move(commands);
+            std::atomic_store(&this->_route, RouteSnapshot(std::move(route)));
+        }
+
+        // Any thread, nullptr before the first route is published
+        RouteSnapshot current() const {
+            return std::atomic_load(&this->_route);
+        }
+
+    private:
+        RouteSnapshot _route;
+        std::atomic<std::uint64_t> _version{0};
+    };
+
     enum StatusControl : int {
         Play = 11,
         Stop = 12
@@ -42,11 +80,14 @@ namespace rb {
         char macAddress[18] = "00:16:53:18:8E:08";
         int chanel = 1;
 
+        // Robot which connects and gets the route, index into StateData::robots
+        int robot = 0;
+
         // Map
-        std::vector<Command> commands;
+        RoutePublisher route;
     };
 
-    struct StateData {
+    struct RobotState {
         StatusControl statusControl = StatusControl::Stop;
 
         StatusConnection statusConnection = StatusConnection::Closed;
@@ -55,4 +96,9 @@ namespace rb {
 
         std::string message = "";
     };
+
+    struct StateData {
+        // One per robot of the fleet
+        std::vector<RobotState> robots;
+    };
 }
\ No newline at end of file
@@ -1,4 +1,6 @@
 #include "detail.h"
+#include "config.h"
+#include "renderer.h"
 #include <experimental/filesystem>
 #include <sstream>
 #include <fstream>
@@ -45,30 +47,32 @@ namespace rb {
             this->_window->setView(this->_view);
         }
 
-        void Graphics::update(float elapsedTime, sf::Vector2f tileSize, bool windowHasFocus) {
-            float amountToMoveX = (
-                    tileSize.x * std::stof(utils::getConfigValue("tile_scale_x")))
-                            / std::stof(utils::getConfigValue("camera_pan_factor"));
+        bool Graphics::update(float elapsedTime, sf::Vector2f tileSize, bool windowHasFocus) {
+            auto config = Config::instance().getSnapshot();
+            float panFactor = config->getFloat("camera_pan_factor", 1.0f);
 
-            float amountToMoveY = (
-                    tileSize.y * std::stof(utils::getConfigValue("tile_scale_y")))
-                            / std::stof(utils::getConfigValue("camera_pan_factor"));
+            float amountToMoveX = (tileSize.x * config->getFloat("tile_scale_x", 1.0f)) / panFactor;
 
+            float amountToMoveY = (tileSize.y * config->getFloat("tile_scale_y", 1.0f)) / panFactor;
+
+            sf::Vector2f offset;
             if (windowHasFocus) {
                 if (sf::Keyboard::isKeyPressed(sf::Keyboard::S)) {
-                    this->_view.move(0, amountToMoveY);
+                    offset.y = amountToMoveY;
                 }
                 else if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) {
-                    this->_view.move(0, -amountToMoveY);
+                    offset.y = -amountToMoveY;
                 }
                 if (sf::Keyboard::isKeyPressed(sf::Keyboard::A)) {
-                    this->_view.move(-amountToMoveX, 0);
+                    offset.x = -amountToMoveX;
                 }
                 else if (sf::Keyboard::isKeyPressed(sf::Keyboard::D)) {
-                    this->_view.move(amountToMoveX, 0);
+                    offset.x = amountToMoveX;
                 }
+                this->_view.move(offset);
                 this->_window->setView(this->_view);
             }
+            return offset.x != 0 || offset.y != 0;
         }
 
         sf::View Graphics::getView() const {
@@ -137,15 +141,13 @@ namespace rb {
             return ret;
         }
 
-        std::string utils::getConfigValue(std::string key) {
-            std::ifstream in("rembot.config");
-            std::map<std::string, std::string> configMap;
-            if (!in.fail()) {
-                for (std::string line; std::getline(in, line); ) {
-                    configMap.insert(std::pair<std::string, std::string>(utils::split(line, '=')[0], utils::split(line, '=')[1]));
-                }
-            }
-            return configMap.size() <= 0 ? "" : configMap[key];
+        std::string utils::getConfigValue(const std::string &key) {
+            return Config::instance().getString(key);
+        }
+
+        sf::Vector2f utils::getTileScale() {
+            auto config = Config::instance().getSnapshot();
+            return sf::Vector2f(config->getFloat("tile_scale_x", 1.0f), config->getFloat("tile_scale_y", 1.0f));
         }
 
         sf::Color utils::getColor(const ImVec4 &c) {
@@ -161,13 +163,16 @@ namespace rb {
         }
 
         void Level::createMap(sf::Vector2i size, sf::Vector2i tileSize) {
-            this->_shapeList.clear();
+            ++this->_revision;
+            this->_shapes.clear();
             this->_size = size;
             this->_tileSize = tileSize;
+            this->_index.clear();
         }
 
         Level::Level(std::shared_ptr<Graphics> graphics) {
             this->_graphics = graphics;
+            this->_revision = 0;
         }
 
         void Level::update(float elapsedTime) {
@@ -182,36 +187,101 @@ namespace rb {
             this->_size = size;
         }
 
-        void Level::addShape(std::shared_ptr<detail::Shape> shape) {
-            this->_shapeList.push_back(shape);
+        ShapeHandle Level::addShape(std::unique_ptr<detail::Shape> shape) {
+            ++this->_revision;
+            const auto &ref = *shape;
+            auto handle = this->_shapes.insert(std::move(shape));
+            this->indexShape(handle, ref);
+            return handle;
         }
 
-        std::vector<std::shared_ptr<detail::Shape>> Level::getShapeList() {
-            return this->_shapeList;
+        const ShapeStore &Level::getShapes() const {
+            return this->_shapes;
         }
 
-        void Level::updateShape(std::shared_ptr<detail::Shape> oldShape, std::shared_ptr<detail::Shape> newShape) {
-            for (unsigned int i = 0; i < this->_shapeList.size(); ++i) {
-                if (oldShape->equals(this->_shapeList[i])) {
-                    this->_shapeList[i] = newShape;
-                    return;
-                }
-            }
+        detail::Shape *Level::getShape(ShapeHandle handle) const {
+            auto shape = this->_shapes.get(handle);
+            return shape != nullptr ? shape->get() : nullptr;
+        }
+
+        void Level::updateShape(ShapeHandle handle) {
+            auto shape = this->getShape(handle);
+            if (shape == nullptr) return;
+            ++this->_revision;
+            this->_index.remove(handle);
+            this->indexShape(handle, *shape);
         }
 
-        void Level::removeShape(std::shared_ptr<detail::Shape> shape) {
-            this->_shapeList.erase(std::remove(this->_shapeList.begin(), this->_shapeList.end(), shape), this->_shapeList.end());
+        void Level::removeShape(ShapeHandle handle) {
+            if (!this->_shapes.contains(handle)) return;
+            ++this->_revision;
+            this->_index.remove(handle);
+            this->_shapes.remove(handle);
         }
 
         sf::Vector2i Level::globalToLocalCoordinates(sf::Vector2f coords) const {
-            return sf::Vector2i(static_cast<int>(coords.x) / this->_tileSize.x / static_cast<int>(std::stof(detail::utils::getConfigValue("tile_scale_x"))) + 1,
-                                static_cast<int>(coords.y) / this->_tileSize.y / static_cast<int>(std::stof(detail::utils::getConfigValue("tile_scale_y"))) + 1);
+            auto tileScale = utils::getTileScale();
+            return sf::Vector2i(static_cast<int>(coords.x) / this->_tileSize.x / static_cast<int>(tileScale.x) + 1,
+                                static_cast<int>(coords.y) / this->_tileSize.y / static_cast<int>(tileScale.y) + 1);
+        }
+
+        sf::Vector2i Level::worldToTile(sf::Vector2f coords) const {
+            auto cellSize = this->getCellSize();
+            return sf::Vector2i(static_cast<int>(std::lround(coords.x / cellSize.x)),
+                                static_cast<int>(std::lround(coords.y / cellSize.y)));
+        }
+
+        sf::Vector2f Level::tileToWorld(sf::Vector2i tile) const {
+            auto cellSize = this->getCellSize();
+            return sf::Vector2f(tile.x * cellSize.x, tile.y * cellSize.y);
+        }
+
+        ShapeHit Level::pick(sf::Vector2f coords) {
+            ShapeHit hit;
+            auto tile = this->worldToTile(coords);
+            this->_index.forEachInRange(sf::IntRect(tile.x - 1, tile.y - 1, 2, 2), [&](const SpatialIndex::Entry &entry) {
+                sf::Vector2f offset = coords - this->tileToWorld(entry.tile);
+                if (offset.x * offset.x + offset.y * offset.y < WAYPOINT_RADIUS * WAYPOINT_RADIUS) {
+                    hit.shape = entry.shape;
+                    hit.waypoint = entry.waypoint;
+                }
+            });
+            return hit;
+        }
+
+        bool Level::hasWaypoint(sf::Vector2i tile) {
+            return this->_index.find(tile) != nullptr;
+        }
+
+        sf::Vector2f Level::getCellSize() const {
+            auto tileScale = utils::getTileScale();
+            return sf::Vector2f(std::max(1.0f, this->_tileSize.x * tileScale.x),
+                                std::max(1.0f, this->_tileSize.y * tileScale.y));
+        }
+
+        void Level::indexShape(ShapeHandle handle, const detail::Shape &shape) {
+            if (auto p = dynamic_cast<const Point *>(&shape)) {
+                this->_index.insert(handle, 0, p->getTile());
+            } else if (auto l = dynamic_cast<const Line *>(&shape)) {
+                const auto &waypoints = l->getWaypoints();
+                for (std::size_t i = 0; i < waypoints.size(); ++i) {
+                    this->_index.insert(handle, static_cast<std::uint32_t>(i), waypoints.getTile(i));
+                }
+            }
         }
 
         sf::Vector2i Level::getTileSize() const {
             return this->_tileSize;
         }
 
+        unsigned long Level::getRevision() const {
+            return this->_revision;
+        }
+
+        void Level::invalidate() {
+            ++this->_revision;
+        }
+
         Shape::Shape(std::string name, sf::Color color) {
             this->_name = name;
             this->_color = color;
@@ -234,106 +304,73 @@ namespace rb {
             this->_color = color;
         }
 
-        Point::Point(std::string name, sf::Color color, sf::CircleShape dot) :
+        bool Shape::isSelected() const {
+            return this->_selected;
+        }
+
+        Point::Point(std::string name, sf::Color color, sf::Vector2i tile) :
                 Shape(name, color)
         {
-            this->_dot = dot;
+            this->_waypoint.tile = tile;
+            this->_waypoint.color = color;
         }
 
-        sf::CircleShape Point::getCircle() {
-            return this->_dot;
+        const Waypoint &Point::getWaypoint() const {
+            return this->_waypoint;
         }
 
-        sf::Color Point::getColor() const {
-            return this->_color;
+        sf::Vector2i Point::getTile() const {
+            return this->_waypoint.tile;
         }
 
-        void Point::setColor(sf::Color color) {
-            this->_color = color;
-            this->_dot.setFillColor(sf::Color(color.r, color.g, color.b, 80));
-            this->_dot.setOutlineColor(sf::Color(color.r, color.g, color.b, 160));
+        void Point::setTile(sf::Vector2i tile) {
+            this->_waypoint.tile = tile;
         }
 
-        void Point::fixPosition(sf::Vector2i levelSize, sf::Vector2i tileSize, sf::Vector2f tileScale) {
-            this->setPosition(sf::Vector2f(
-                    std::min(this->getCircle().getPosition().x, levelSize.x * tileSize.x * tileScale.x -
-                                                                (this->getCircle().getRadius() * 2)),
-                    std::min(this->getCircle().getPosition().y, levelSize.y * tileSize.y * tileScale.y - (this->getCircle().getRadius() * 2))));
+        void Point::setColor(sf::Color color) {
+            this->_color = color;
+            this->_waypoint.color = color;
         }
 
-        bool Point::isPointInside(sf::Vector2f point) {
-            sf::Vector2f center = sf::Vector2f(this->_dot.getGlobalBounds().left + (this->_dot.getGlobalBounds().width / 2),
-                                               this->_dot.getGlobalBounds().top + (this->_dot.getGlobalBounds().height / 2));
-            auto x = pow(point.x - center.x, 2);
-            auto y = pow(point.y - center.y, 2);
-            return pow(this->_dot.getRadius(), 2) > (x + y);
+        void Point::fixPosition(sf::Vector2i levelSize) {
+            this->_waypoint.tile.x = std::max(0, std::min(this->_waypoint.tile.x, levelSize.x));
+            this->_waypoint.tile.y = std::max(0, std::min(this->_waypoint.tile.y, levelSize.y));
         }
 
         void Point::select() {
-            if (!this->_selected) {
-                this->_selected = true;
-                this->_dot.setOutlineThickness(this->_dot.getOutlineThickness() + 3);
-                this->_dot.setFillColor(sf::Color(static_cast<sf::Uint8>(std::min(155, this->_dot.getFillColor().r + 16)),
-                                                  static_cast<sf::Uint8>(std::min(155, this->_dot.getFillColor().g + 16)),
-                                                  static_cast<sf::Uint8>(std::min(155, this->_dot.getFillColor().b + 16)),
-                                                  static_cast<sf::Uint8>(std::min(155, this->_dot.getFillColor().a + 16))
-                ));
-            }
+            this->_selected = true;
+            this->_waypoint.flags |= WAYPOINT_SELECTED;
         }
 
         void Point::unselect() {
-            if (this->_selected) {
-                this->_selected = false;
-                this->_dot.setOutlineThickness(this->_dot.getOutlineThickness() - 3);
-                this->_dot.setFillColor(sf::Color(static_cast<sf::Uint8>(std::max(0, this->_dot.getFillColor().r - 16)),
-                                                  static_cast<sf::Uint8>(std::max(0, this->_dot.getFillColor().g - 16)),
-                                                  static_cast<sf::Uint8>(std::max(0, this->_dot.getFillColor().b - 16)),
-                                                  static_cast<sf::Uint8>(std::max(0, this->_dot.getFillColor().a - 16))
-                ));
-            }
-        }
-
-        void Point::setPosition(sf::Vector2f pos) {
-            this->_dot.setPosition(pos);
-        }
-
-        void Point::setSize(sf::Vector2f size) {
-            this->_dot.setRadius(size.x);
+            this->_selected = false;
+            this->_waypoint.flags &= static_cast<std::uint8_t>(~WAYPOINT_SELECTED);
         }
 
-        void Point::draw(sf::RenderWindow *window) {
-            window->draw(this->_dot);
+        sf::IntRect Point::getTileBounds() const {
+            return sf::IntRect(this->_waypoint.tile.x, this->_waypoint.tile.y, 0, 0);
         }
 
-        bool Point::equals(std::shared_ptr<Shape> other) {
-            std::shared_ptr<detail::Point> p = std::dynamic_pointer_cast<detail::Point>(other);
-            if (p == nullptr) return false;
-            return this->_name == p->getName() &&
-                   this->_color == p->getColor() &&
-                   this->_dot.getPosition() == p->getCircle().getPosition();
+        void Point::draw(ShapeBatch &batch) const {
+            batch.addWaypoint(this->_waypoint.tile, this->_waypoint.color,
+                              (this->_waypoint.flags & WAYPOINT_SELECTED) != 0);
         }
 
-        Line::Line(std::string name, sf::Color color, std::vector<std::shared_ptr<Point>> points) :
+        Line::Line(std::string name, sf::Color color, WaypointStore waypoints) :
                 Shape(name, color)
         {
-            this->_points = points;
+            this->_waypoints = std::move(waypoints);
+            this->_boundsValid = false;
         }
 
-        std::vector<std::shared_ptr<Point>> Line::getPoints() {
-            return this->_points;
-        }
-
-        std::shared_ptr<Point> Line::getSelectedPoint(sf::Vector2f mousePos) {
-            for (auto &p : this->_points) {
-                if (p->isPointInside(mousePos)) {
-                    return p;
-                }
-            }
-            return nullptr;
+        const WaypointStore &Line::getWaypoints() const {
+            return this->_waypoints;
         }
 
-        void Line::deletePoint(std::shared_ptr<Point> p) {
-            this->_points.erase(std::remove(this->_points.begin(), this->_points.end(), p), this->_points.end());
+        void Line::deleteWaypoint(std::size_t index) {
+            if (index >= this->_waypoints.size()) return;
+            this->_waypoints.erase(index);
+            this->_boundsValid = false;
         }
 
         sf::Color Line::getColor() const {
@@ -344,89 +381,81 @@ namespace rb {
             this->_color = color;
         }
 
-        void Line::fixPosition(sf::Vector2i levelSize, sf::Vector2i tileSize, sf::Vector2f tileScale) {
-            for (auto &p : this->_points) {
-                p->fixPosition(levelSize, tileSize, tileScale);
+        void Line::fixPosition(sf::Vector2i levelSize) {
+            for (std::size_t i = 0; i < this->_waypoints.size(); ++i) {
+                auto tile = this->_waypoints.getTile(i);
+                this->_waypoints.setTile(i, sf::Vector2i(std::max(0, std::min(tile.x, levelSize.x)),
+                                                         std::max(0, std::min(tile.y, levelSize.y))));
             }
-        }
-
-        bool Line::isPointInside(sf::Vector2f point) {
-            //Points
-            for (auto &p : this->_points) {
-                if (p->isPointInside(point)) {
-                    return true;
-                }
-            }
-            return false;
+            this->_boundsValid = false;
         }
 
         void Line::select() {
-            for (auto &p : this->_points) {
-                p->select();
-            }
+            this->_selected = true;
+            this->_waypoints.setFlag(WAYPOINT_SELECTED, true);
         }
 
         void Line::unselect() {
-            for (auto &p : this->_points) {
-                p->unselect();
-            }
+            this->_selected = false;
+            this->_waypoints.setFlag(WAYPOINT_SELECTED, false);
         }
 
-        void Line::setPosition(sf::Vector2f pos) {
-            throw utils::NotImplementedException("setPosition");
+        sf::IntRect Line::getTileBounds() const {
+            this->updateBounds();
+            return this->_bounds;
         }
 
-        void Line::setSize(sf::Vector2f size) {
-            throw utils::NotImplementedException("setSize");
+        void Line::updateBounds() const {
+            if (this->_boundsValid) return;
+
+            const auto &xs = this->_waypoints.getX();
+            const auto &ys = this->_waypoints.getY();
+            auto bounds = [&](std::size_t begin, std::size_t end) {
+                int left = xs[begin], right = xs[begin], top = ys[begin], bottom = ys[begin];
+                for (std::size_t i = begin + 1; i < end; ++i) {
+                    left = std::min(left, xs[i]);
+                    right = std::max(right, xs[i]);
+                    top = std::min(top, ys[i]);
+                    bottom = std::max(bottom, ys[i]);
+                }
+                return sf::IntRect(left, top, right - left, bottom - top);
+            };
+
+            // A chunk also covers the first point of the next one, which ends its last segment
+            this->_chunkBounds.clear();
+            for (std::size_t begin = 0; begin < this->_waypoints.size(); begin += SEGMENT_CHUNK) {
+                this->_chunkBounds.push_back(bounds(begin, std::min(begin + SEGMENT_CHUNK + 1, this->_waypoints.size())));
+            }
+            this->_bounds = this->_waypoints.empty() ? sf::IntRect() : bounds(0, this->_waypoints.size());
+            this->_boundsValid = true;
         }
 
-        void Line::draw(sf::RenderWindow *window) {
-            for (auto &p : this->_points) {
-                p->draw(window);
+        void Line::draw(ShapeBatch &batch) const {
+            const std::size_t count = this->_waypoints.size();
+            if (count == 0) return;
+            if (!batch.isVisible(this->getTileBounds())) {
+                batch.cull(count * 2 - 1);
+                return;
             }
-            if (this->_points.size() >= 2) {
-                for (unsigned int i = 0; i < this->_points.size() - 1; ++i) {
-                    sf::Vertex v[4];
-                    sf::Vector2f point1 = sf::Vector2f(this->_points[i]->getCircle().getPosition().x + this->_points[i]->getCircle().getRadius(),
-                                                       this->_points[i]->getCircle().getPosition().y + this->_points[i]->getCircle().getRadius());
-                    sf::Vector2f point2 = sf::Vector2f(this->_points[i + 1]->getCircle().getPosition().x + this->_points[i + 1]->getCircle().getRadius(),
-                                                       this->_points[i + 1]->getCircle().getPosition().y + this->_points[i + 1]->getCircle().getRadius());
-
-                    sf::Vector2f direction = point2 - point1;
-
-                    sf::Vector2f unitDirection = direction/std::sqrt(direction.x*direction.x+direction.y*direction.y);
-                    sf::Vector2f unitPerpendicular(-unitDirection.y,unitDirection.x);
-
-                    sf::Vector2f offset = (3.0f / 2.0f) * unitPerpendicular;
-
-                    v[0].position = point1 + offset;
-                    v[1].position = point2 + offset;
-                    v[2].position = point2 - offset;
-                    v[3].position = point1 - offset;
-                    for (int i = 0; i < 4; ++i) {
-                        v[i].color = this->_color;
+            for (std::size_t c = 0; c < this->_chunkBounds.size(); ++c) {
+                std::size_t begin = c * SEGMENT_CHUNK;
+                std::size_t end = std::min(begin + SEGMENT_CHUNK, count);
+                std::size_t segments = std::min(end, count - 1) - begin;
+
+                if (!batch.isVisible(this->_chunkBounds[c])) {
+                    batch.cull((end - begin) + segments);
+                    continue;
+                }
+                for (std::size_t i = begin; i < end; ++i) {
+                    batch.addWaypoint(this->_waypoints.getTile(i), this->_waypoints.getColor(i),
+                                      this->_waypoints.hasFlag(i, WAYPOINT_SELECTED));
+                    if (i + 1 < count) {
+                        batch.addSegment(batch.toWorld(this->_waypoints.getTile(i)),
+                                         batch.toWorld(this->_waypoints.getTile(i + 1)), 3.0f, this->_color);
                     }
-                    window->draw(v, 4, sf::Quads);
                 }
             }
         }
 
-        bool Line::equals(std::shared_ptr<Shape> other) {
-            std::shared_ptr<Line> l = std::dynamic_pointer_cast<Line>(other);
-            if (l == nullptr) return false;
-            return this->_name == l->getName() &&
-                   this->_color == l->getColor() &&
-                   [&]()->bool {
-                       if (this->_points.size() != l->getPoints().size()) return false;
-                       for (unsigned int i = 0; i < this->_points.size(); ++i) {
-                           if (!this->_points[i]->equals(l->getPoints()[i])) {
-                               return false;
-                           }
-                       }
-                       return true;
-                   }();
-        }
-
-
     }
 }
\ No newline at end of file
@@ -6,6 +6,9 @@
 #include <sstream>
 #include <cstring>
 #include "../libext/imgui.h"
+#include "slotmap.h"
+#include "spatial.h"
+#include "waypoints.h"
 
 namespace rb {
     namespace detail {
@@ -15,6 +18,8 @@ namespace rb {
          */
         class Shape;
 
+        class ShapeBatch;
+
         enum class Features {
             None, Map
         };
@@ -31,7 +36,7 @@ namespace rb {
             None, TilesetWindow, NewMapWindow, ControlPlayWindow, ConfigWindow, MapSelectWindow, AboutWindow, LightEditorWindow,
             NewAnimatedSpriteWindow, NewAnimationWindow, RemoveAnimationWindow, EntityListWindow, EntityPropertiesWindow, ShapeColorWindow,
             ConfigureMapWindow, ConfigureBackgroundColorWindow, ConsoleWindow, BackgroundWindow, TileTypeWindow,
-            TileTypeColorSelectionWindow
+            TileTypeColorSelectionWindow, MetricsWindow
         };
 
         namespace utils {
@@ -49,7 +54,9 @@ namespace rb {
 
             std::vector<const char *> getFilesInDirectory(std::string directory);
 
-            std::string getConfigValue(std::string key);
+            std::string getConfigValue(const std::string &key);
+
+            sf::Vector2f getTileScale();
 
             sf::Color getColor(const ImVec4 &c);
 
@@ -75,7 +82,8 @@ namespace rb {
 
             void zoom(float n, sf::Vector2i pixel);
 
-            void update(float elapsedTime, sf::Vector2f tileSize, bool windowHasFocus);
+            // Pans the camera with the keyboard, returns true if the view moved
+            bool update(float elapsedTime, sf::Vector2f tileSize, bool windowHasFocus);
 
             sf::View getView() const;
 
@@ -90,6 +98,16 @@ namespace rb {
         };
 
 
+        using ShapeHandle = SlotHandle;
+
+        using ShapeStore = SlotMap<std::unique_ptr<Shape>>;
+
+        struct ShapeHit {
+            ShapeHandle shape;
+            // Position of the waypoint in the shape
+            std::size_t waypoint = 0;
+        };
+
         class Level {
         public:
             Level(std::shared_ptr<Graphics> graphics);
@@ -106,19 +124,52 @@ namespace rb {
 
             sf::Vector2i getTileSize() const;
 
-            void addShape(std::shared_ptr<detail::Shape> shape);
+            // Size of a tile in world units with the tile scale applied
+            sf::Vector2f getCellSize() const;
 
-            std::vector<std::shared_ptr<detail::Shape>> getShapeList();
+            ShapeHandle addShape(std::unique_ptr<detail::Shape> shape);
 
-            void updateShape(std::shared_ptr<detail::Shape> oldShape, std::shared_ptr<detail::Shape> newShape);
+            // Non-owning view of the shapes, invalidated by adding or removing a shape
+            const ShapeStore &getShapes() const;
 
-            void removeShape(std::shared_ptr<detail::Shape> shape);
+            // Returns nullptr if the shape was removed
+            detail::Shape *getShape(ShapeHandle handle) const;
+
+            template<class T>
+            T *getShape(ShapeHandle handle) const {
+                return dynamic_cast<T *>(this->getShape(handle));
+            }
+
+            // Must be called after a shape of the level was modified in place
+            void updateShape(ShapeHandle handle);
+
+            void removeShape(ShapeHandle handle);
 
             sf::Vector2i globalToLocalCoordinates(sf::Vector2f coords) const;
 
+            // Returns the grid intersection nearest to the coordinates
+            sf::Vector2i worldToTile(sf::Vector2f coords) const;
+
+            sf::Vector2f tileToWorld(sf::Vector2i tile) const;
+
+            // Returns the waypoint under the coordinates, the last added one if they overlap
+            ShapeHit pick(sf::Vector2f coords);
+
+            bool hasWaypoint(sf::Vector2i tile);
+
+            // Incremented on every change of the shapes, used by renderers to know when to rebuild
+            unsigned long getRevision() const;
+
+            // Must be called after a shape of the level was modified in place
+            void invalidate();
+
         private:
+            void indexShape(ShapeHandle handle, const detail::Shape &shape);
+
+            unsigned long _revision;
             sf::Vector2i _size;
-            std::vector<std::shared_ptr<detail::Shape>> _shapeList;
+            ShapeStore _shapes;
+            SpatialIndex _index;
             std::shared_ptr<Graphics> _graphics;
             sf::Vector2i _tileSize;
         };
@@ -127,6 +178,8 @@ namespace rb {
         public:
             Shape(std::string name, sf::Color color);
 
+            virtual ~Shape() = default;
+
             std::string getName();
 
             virtual sf::Color getColor() const;
@@ -135,21 +188,19 @@ namespace rb {
 
             virtual void setColor(sf::Color color);
 
-            virtual void fixPosition(sf::Vector2i levelSize, sf::Vector2i tileSize, sf::Vector2f tileScale) = 0;
+            bool isSelected() const;
 
-            virtual bool isPointInside(sf::Vector2f point) = 0;
+            // Moves the waypoints which are outside of the map onto its border
+            virtual void fixPosition(sf::Vector2i levelSize) = 0;
 
             virtual void select() = 0;
 
             virtual void unselect() = 0;
 
-            virtual void setPosition(sf::Vector2f pos) = 0;
+            // Tiles covered by the waypoints of the shape
+            virtual sf::IntRect getTileBounds() const = 0;
 
-            virtual void setSize(sf::Vector2f size) = 0;
-
-            virtual void draw(sf::RenderWindow *window) = 0;
-
-            virtual bool equals(std::shared_ptr<Shape> other) = 0;
+            virtual void draw(ShapeBatch &batch) const = 0;
 
         protected:
             std::string _name;
@@ -160,40 +211,42 @@ namespace rb {
 
         class Point : public Shape {
         public:
-            Point(std::string name, sf::Color color, sf::CircleShape dot);
-            sf::CircleShape getCircle();
-            virtual sf::Color getColor() const override;
+            Point(std::string name, sf::Color color, sf::Vector2i tile);
+            const Waypoint &getWaypoint() const;
+            sf::Vector2i getTile() const;
+            void setTile(sf::Vector2i tile);
             virtual void setColor(sf::Color color) override;
-            virtual void fixPosition(sf::Vector2i levelSize, sf::Vector2i tileSize, sf::Vector2f tileScale) override;
-            virtual bool isPointInside(sf::Vector2f point) override;
+            virtual void fixPosition(sf::Vector2i levelSize) override;
             virtual void select() override;
             virtual void unselect() override;
-            virtual void setPosition(sf::Vector2f pos) override;
-            virtual void setSize(sf::Vector2f size) override;
-            virtual void draw(sf::RenderWindow* window) override;
-            virtual bool equals(std::shared_ptr<Shape> other) override;
+            virtual sf::IntRect getTileBounds() const override;
+            virtual void draw(ShapeBatch &batch) const override;
         private:
-            sf::CircleShape _dot;
+            Waypoint _waypoint;
         };
 
         class Line : public Shape {
         public:
-            Line(std::string name, sf::Color color, std::vector<std::shared_ptr<Point>> points);
-            std::vector<std::shared_ptr<Point>> getPoints();
-            std::shared_ptr<Point> getSelectedPoint(sf::Vector2f mousePos);
-            void deletePoint(std::shared_ptr<Point> p);
+            Line(std::string name, sf::Color color, WaypointStore waypoints);
+            const WaypointStore &getWaypoints() const;
+            void deleteWaypoint(std::size_t index);
             virtual sf::Color getColor() const override;
             virtual void setColor(sf::Color color) override;
-            virtual void fixPosition(sf::Vector2i levelSize, sf::Vector2i tileSize, sf::Vector2f tileScale) override;
-            virtual bool isPointInside(sf::Vector2f point) override;
+            virtual void fixPosition(sf::Vector2i levelSize) override;
             virtual void select() override;
             virtual void unselect() override;
-            virtual void setPosition(sf::Vector2f pos) override;
-            virtual void setSize(sf::Vector2f size) override;
-            virtual void draw(sf::RenderWindow* window) override;
-            virtual bool equals(std::shared_ptr<Shape> other) override;
+            virtual sf::IntRect getTileBounds() const override;
+            virtual void draw(ShapeBatch &batch) const override;
         private:
-            std::vector<std::shared_ptr<Point>> _points;
+            // Number of segments sharing one bounding box for culling
+            static const std::size_t SEGMENT_CHUNK = 64;
+
+            void updateBounds() const;
+
+            WaypointStore _waypoints;
+            mutable std::vector<sf::IntRect> _chunkBounds;
+            mutable sf::IntRect _bounds;
+            mutable bool _boundsValid;
         };
 
     }
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <utility>
 
 #include "editor.h"
@@ -10,9 +11,14 @@
 #include "../libext/imgui_internal.h"
 
 #include "data.h"
+#include "metrics.h"
+#include "path_compiler.h"
 
 namespace rb {
 
+    // Bounded only by float precision of the world coordinates
+    static const int MAX_MAP_SIZE = 100000;
+
     struct Editor::Data {
         Data() : stateInput(new StateInput()) {}
 
@@ -32,6 +38,8 @@ namespace rb {
             _level(this->_graphics),
             _menuClicks(0),
             _attachPoint(false),
+            _cameraMoved(false),
+            _statusActive(false),
             _showEntityList(false),
             _currentDrawShape(detail::DrawShapes::None),
             _currentWindowType(detail::WindowTypes::NewMapWindow),
@@ -40,7 +48,6 @@ namespace rb {
 
         ImGui::SFML::Init(*window);
         this->_window = window;
-        this->createGridLines();
     }
 
     void Editor::render() {
@@ -50,6 +57,12 @@ namespace rb {
         const auto &inp = _data->stateInput;
         const auto &data = _data->stateDataLocked;
 
+        // Menus follow the robot selected in the Robot menu
+        inp->robot = std::max(0, std::min(inp->robot, static_cast<int>(data->robots.size()) - 1));
+        auto &robot = data->robots[inp->robot];
+
+        const sf::Vector2f tileScale = detail::utils::getTileScale();
+
         //Return the current mouse position
         static auto getMousePos = [&]() -> sf::Vector2f {
             return this->_window->mapPixelToCoords(sf::Vector2i(
@@ -62,22 +75,15 @@ namespace rb {
         this->_window->clear(sf::Color(30, 30, 30, 255));
 
         if (this->_showGridLines) {
-            for (auto &t : this->_gridLines) {
-                this->_graphics->draw(t.data(), 2, sf::Lines);
-            }
+            this->_gridRenderer.draw(this->_level, *this->_graphics);
         }
 
         //Draw shapes
         if (!this->_hideShapes) {
-            for (std::shared_ptr<detail::Shape> shape : this->_level.getShapeList()) {
-                shape.get()->draw(this->_window);
-            }
+            this->_shapeRenderer.draw(this->_level, *this->_graphics);
         }
 
-        auto sizeBoxSelected = (this->_level.getTileSize().x *
-                                std::stof(
-                                        detail::utils::getConfigValue(
-                                                "tile_scale_x"))) / 10;
+        auto sizeBoxSelected = (this->_level.getTileSize().x * tileScale.x) / 10;
 
 
         //Shape creation
@@ -85,39 +91,24 @@ namespace rb {
             //Points
             if (this->_currentDrawShape == detail::DrawShapes::Point) {
                 static sf::Vector2f mousePos = getMousePos();
-                static sf::CircleShape dot;
-                static const float DOT_RADIUS = 6.0f;
                 if (this->_currentEvent.type == sf::Event::MouseButtonReleased &&
                     this->_currentEvent.mouseButton.button == sf::Mouse::Left) {
                     if (++this->_menuClicks > 1) {
                         mousePos = getMousePos();
                         mousePos.x = std::max(0.0f, mousePos.x);
-                        mousePos.x = std::min(this->_level.getSize().x *
-                                              std::stof(detail::utils::getConfigValue("tile_scale_x")) *
+                        mousePos.x = std::min(this->_level.getSize().x * tileScale.x *
                                               this->_level.getTileSize().x, mousePos.x);
                         mousePos.y = std::max(0.0f, mousePos.y);
-                        mousePos.y = std::min(this->_level.getSize().y *
-                                              std::stof(detail::utils::getConfigValue("tile_scale_y")) *
+                        mousePos.y = std::min(this->_level.getSize().y * tileScale.y *
                                               this->_level.getTileSize().y, mousePos.y);
-                        dot.setRadius(DOT_RADIUS);
-                        dot.setPosition(
-                                std::floor(mousePos.x - ((int) mousePos.x % (int) (this->_level.getTileSize().x *
-                                                                                   std::stof(
-                                                                                           detail::utils::getConfigValue(
-                                                                                                   "tile_scale_x")))) -
-                                           DOT_RADIUS),
-                                std::floor(mousePos.y - ((int) mousePos.y % (int) (this->_level.getTileSize().y *
-                                                                                   std::stof(
-                                                                                           detail::utils::getConfigValue(
-                                                                                                   "tile_scale_y"))))) -
-                                DOT_RADIUS);
-                        dot.setFillColor(sf::Color(0, 0, 255, 80));
-                        dot.setOutlineColor(sf::Color(0, 0, 255, 160));
-                        dot.setOutlineThickness(2.0f);
-                        this->_level.addShape(std::make_shared<detail::Point>("Point", sf::Color::Blue, dot));
+                        sf::Vector2i tile((int) mousePos.x / (int) (this->_level.getTileSize().x * tileScale.x),
+                                          (int) mousePos.y / (int) (this->_level.getTileSize().y * tileScale.y));
+                        if (this->_attachPoint || !this->_level.hasWaypoint(tile)) {
+                            this->_level.addShape(std::unique_ptr<detail::Shape>(new detail::Point("Point", sf::Color::Blue, tile)));
+                            this->_currentDrawShape = detail::DrawShapes::None;
+                            this->_menuClicks = 0;
+                        }
                         this->_currentEvent = sf::Event();
-                        this->_currentDrawShape = detail::DrawShapes::None;
-                        this->_menuClicks = 0;
                     } else {
                         this->_currentEvent = sf::Event();
                     }
@@ -128,108 +119,62 @@ namespace rb {
             if (this->_currentDrawShape == detail::DrawShapes::Line &&
                 this->_currentMapEditorMode == detail::MapEditorMode::Object) {
                 static sf::Vector2f mousePos = getMousePos();
-                static std::vector<std::shared_ptr<detail::Point>> points;
+                static detail::WaypointStore points;
+
+                static std::size_t previewSize = 0;
+                static sf::Vector2f previewCellSize;
 
                 //Draw temporary points / line
-                for (auto &p : points) {
-                    p->draw(this->_window);
-                }
-                //Draw connecting lines between the points
-                if (points.size() >= 2) {
-                    for (unsigned int i = 0; i < points.size() - 1; ++i) {
-                        sf::Vertex v[4];
-                        sf::Vector2f point1 = sf::Vector2f(
-                                points[i]->getCircle().getPosition().x + points[i]->getCircle().getRadius(),
-                                points[i]->getCircle().getPosition().y + points[i]->getCircle().getRadius());
-                        sf::Vector2f point2 = sf::Vector2f(
-                                points[i + 1]->getCircle().getPosition().x + points[i + 1]->getCircle().getRadius(),
-                                points[i + 1]->getCircle().getPosition().y + points[i + 1]->getCircle().getRadius());
-
-                        sf::Vector2f direction = point2 - point1;
-
-                        sf::Vector2f unitDirection =
-                                direction / std::sqrt(direction.x * direction.x + direction.y * direction.y);
-                        sf::Vector2f unitPerpendicular(-unitDirection.y, unitDirection.x);
-
-                        sf::Vector2f offset = (3.0f / 2.0f) * unitPerpendicular;
-
-                        v[0].position = point1 + offset;
-                        v[1].position = point2 + offset;
-                        v[2].position = point2 - offset;
-                        v[3].position = point1 - offset;
-
-                        this->_graphics->draw(v, 4, sf::Quads);
+                const sf::Vector2f cellSize = this->_level.getCellSize();
+                if (previewSize != points.size() || previewCellSize != cellSize) {
+                    this->_previewBatch.clear();
+                    this->_previewBatch.setCellSize(cellSize);
+                    for (std::size_t i = 0; i < points.size(); ++i) {
+                        this->_previewBatch.addWaypoint(points.getTile(i), points.getColor(i), false);
+                    }
+                    //Connecting lines between the points
+                    for (std::size_t i = 1; i < points.size(); ++i) {
+                        this->_previewBatch.addSegment(this->_previewBatch.toWorld(points.getTile(i - 1)),
+                                                       this->_previewBatch.toWorld(points.getTile(i)), 3.0f,
+                                                       sf::Color::White);
                     }
+                    previewSize = points.size();
+                    previewCellSize = cellSize;
                 }
-                static const float DOT_RADIUS = 6.0f;
+                this->_previewBatch.draw(*this->_graphics);
                 if (this->_currentEvent.type == sf::Event::MouseButtonReleased) {
                     if (this->_currentEvent.mouseButton.button == sf::Mouse::Left) {
                         if (++this->_menuClicks > 1) {
                             mousePos = getMousePos();
                             mousePos.x = std::max(0.0f, mousePos.x);
-                            mousePos.x = std::min(this->_level.getSize().x *
-                                                  std::stof(detail::utils::getConfigValue("tile_scale_x")) *
+                            mousePos.x = std::min(this->_level.getSize().x * tileScale.x *
                                                   this->_level.getTileSize().x, mousePos.x);
                             mousePos.y = std::max(0.0f, mousePos.y);
-                            mousePos.y = std::min(this->_level.getSize().y *
-                                                  std::stof(detail::utils::getConfigValue("tile_scale_y")) *
+                            mousePos.y = std::min(this->_level.getSize().y * tileScale.y *
                                                   this->_level.getTileSize().y, mousePos.y);
 
 
-                            auto positionX = std::floor(
-                                    mousePos.x - ((int) mousePos.x % (int) (this->_level.getTileSize().x *
-                                                                            std::stof(
-                                                                                    detail::utils::getConfigValue(
-                                                                                            "tile_scale_x")))) -
-                                    DOT_RADIUS);
-
-
-                            auto positionY = std::floor(
-                                    mousePos.y - ((int) mousePos.y % (int) (this->_level.getTileSize().y *
-                                                                            std::stof(
-                                                                                    detail::utils::getConfigValue(
-                                                                                            "tile_scale_y")))) -
-                                    DOT_RADIUS);
-
-                            auto it = std::find_if(points.begin(), points.end(),
-                                                   [positionX, positionY](std::shared_ptr<detail::Point> &point) {
-                                                       return point->getCircle().getPosition() ==
-                                                              sf::Vector2f(positionX, positionY);
-                                                   });
-
-
-                            if (this->_attachPoint || it == points.end()) {
-
-
-                                if (!points.empty()) {
-                                    auto positionLastPoint = points.back()->getCircle().getPosition();
-
-                                    if (positionLastPoint.x == positionX || positionLastPoint.y == positionY) {
-
-                                        sf::CircleShape c;
-                                        c.setRadius(DOT_RADIUS);
-                                        c.setPosition(positionX, positionY);
-                                        c.setFillColor(sf::Color(0, 180, 0, 80));
-                                        c.setOutlineColor(sf::Color(0, 180, 0, 160));
-                                        c.setOutlineThickness(2.0f);
-                                        points.push_back(
-                                                std::make_shared<detail::Point>(
-                                                        "p" + std::to_string((points.size() + 1)),
-                                                        sf::Color(0, 255, 0), c));
-                                        this->_currentEvent = sf::Event();
-                                    }
-                                } else {
-                                    sf::CircleShape c;
-                                    c.setRadius(DOT_RADIUS);
-                                    c.setPosition(positionX, positionY);
-                                    c.setFillColor(sf::Color(0, 180, 0, 80));
-                                    c.setOutlineColor(sf::Color(0, 180, 0, 160));
-                                    c.setOutlineThickness(2.0f);
-                                    points.push_back(
-                                            std::make_shared<detail::Point>("p" + std::to_string((points.size() + 1)),
-                                                                            sf::Color(0, 255, 0), c));
-                                    this->_currentEvent = sf::Event();
+                            sf::Vector2i tile((int) mousePos.x / (int) (this->_level.getTileSize().x * tileScale.x),
+                                              (int) mousePos.y / (int) (this->_level.getTileSize().y * tileScale.y));
 
+                            // Without attaching, a waypoint may not land on one of the level or of this line
+                            bool onWaypoint = this->_level.hasWaypoint(tile);
+                            for (std::size_t i = 0; i < points.size() && !onWaypoint; ++i) {
+                                onWaypoint = points.getTile(i) == tile;
+                            }
+
+                            if (this->_attachPoint || !onWaypoint) {
+
+                                // Only straight moves, the next point must share a row or a column with the last one
+                                auto lastTile = points.empty() ? tile : points.getTile(points.size() - 1);
+                                if (lastTile.x == tile.x || lastTile.y == tile.y) {
+                                    detail::Waypoint waypoint;
+                                    waypoint.tile = tile;
+                                    waypoint.color = sf::Color(0, 180, 0);
+                                    waypoint.name = detail::NameTable::instance().intern(
+                                            "p" + std::to_string((points.size() + 1)));
+                                    points.push(waypoint);
+                                    this->_currentEvent = sf::Event();
                                 }
                             }
                         } else {
@@ -239,7 +184,7 @@ namespace rb {
                     if (this->_currentEvent.mouseButton.button == sf::Mouse::Right) {
                         if (points.size() >= 2) {
                             //Save the line!
-                            this->_level.addShape(std::make_shared<detail::Line>("Line", sf::Color::White, points));
+                            this->_level.addShape(std::unique_ptr<detail::Shape>(new detail::Line("Line", sf::Color::White, points)));
                         }
                         points.clear();
                         this->_currentEvent = sf::Event();
@@ -254,27 +199,17 @@ namespace rb {
         sf::Vector2f mousePos = getMousePos();
 
 
-        auto mousePosBoxX = (this->_level.getSize().x * this->_level.getTileSize().x *
-                             std::stof(
-                                     detail::utils::getConfigValue("tile_scale_x")));
+        auto mousePosBoxX = (this->_level.getSize().x * this->_level.getTileSize().x * tileScale.x);
 
-        auto mousePosBoxY = (this->_level.getSize().y * this->_level.getTileSize().y *
-                             std::stof(
-                                     detail::utils::getConfigValue("tile_scale_y")));
+        auto mousePosBoxY = (this->_level.getSize().y * this->_level.getTileSize().y * tileScale.y);
 
 
         if (mousePos.x >= 0 && (mousePos.x <= mousePosBoxX) &&
             mousePos.y >= 0 && mousePos.y <= mousePosBoxY) {
 
-            auto diffTileMouseX = (int) mousePos.x % (int) (this->_level.getTileSize().x *
-                                                            std::stof(
-                                                                    detail::utils::getConfigValue(
-                                                                            "tile_scale_x")));
+            auto diffTileMouseX = (int) mousePos.x % (int) (this->_level.getTileSize().x * tileScale.x);
 
-            auto diffTileMouseY = (int) mousePos.y % (int) (this->_level.getTileSize().y *
-                                                            std::stof(
-                                                                    detail::utils::getConfigValue(
-                                                                            "tile_scale_y")));
+            auto diffTileMouseY = (int) mousePos.y % (int) (this->_level.getTileSize().y * tileScale.y);
 
             if ((std::abs(diffTileMouseX) <= sizeBoxSelected) &&
                 (std::abs(diffTileMouseY) <= sizeBoxSelected)) {
@@ -288,15 +223,9 @@ namespace rb {
 
 
                 rectangleBox.setPosition(
-                        std::floor(mousePos.x - ((int) mousePos.x % (int) (this->_level.getTileSize().x *
-                                                                           std::stof(
-                                                                                   detail::utils::getConfigValue(
-                                                                                           "tile_scale_x")))) -
+                        std::floor(mousePos.x - ((int) mousePos.x % (int) (this->_level.getTileSize().x * tileScale.x)) -
                                    sizeBoxSelected),
-                        std::floor(mousePos.y - ((int) mousePos.y % (int) (this->_level.getTileSize().y *
-                                                                           std::stof(
-                                                                                   detail::utils::getConfigValue(
-                                                                                           "tile_scale_y"))))) -
+                        std::floor(mousePos.y - ((int) mousePos.y % (int) (this->_level.getTileSize().y * tileScale.y))) -
                         sizeBoxSelected);
                 rectangleBox.setFillColor(sf::Color::Transparent);
                 this->_window->draw(rectangleBox);
@@ -314,17 +243,16 @@ namespace rb {
         static bool cbAttachShapes = false;
         static bool entityPropertiesLoaded = false;
         static bool showEntityProperties = false;
+        static bool metricsVisible = false;
 
 
         cbShowEntityList = this->_showEntityList;
 
         //Point
-        static std::shared_ptr<detail::Point> selectedEntityPoint;
-        static std::shared_ptr<detail::Point> originalSelectedEntityPoint;
+        static detail::ShapeHandle selectedEntityPoint;
 
         //Line
-        static std::shared_ptr<detail::Line> selectedEntityLine;
-        static std::shared_ptr<detail::Line> originalSelectedEntityLine;
+        static detail::ShapeHandle selectedEntityLine;
 
 
         // Status bar
@@ -344,22 +272,24 @@ namespace rb {
         //Draw active point color custom
         /* if (selectedEntityLine) {
             auto points = selectedEntityLine->getPoints();
-            if (data->statusControl == StatusControl::Play) {
-                points.at(data->positionActive)->setColor(sf::Color::Red);
-                if (data->positionActive > 0) {
-                    points.at(data->positionActive - 1)->setColor(sf::Color(0, 255, 0));
+            if (robot.statusControl == StatusControl::Play) {
+                points.at(robot.positionActive)->setColor(sf::Color::Red);
+                if (robot.positionActive > 0) {
+                    points.at(robot.positionActive - 1)->setColor(sf::Color(0, 255, 0));
                 }
-            } else if (data->statusControl == StatusControl::Stop) {
-                if (points.size() >= data->positionActive+1) {
-                    points.at(data->positionActive)->setColor(sf::Color(0, 255, 0));
+            } else if (robot.statusControl == StatusControl::Stop) {
+                if (points.size() >= robot.positionActive+1) {
+                    points.at(robot.positionActive)->setColor(sf::Color(0, 255, 0));
                 }
             }
         } */
 
         // Show messages core
-        if (!data->message.empty()) {
-            startStatusTimer(data->message, 200);
-            data->message.clear();
+        for (std::size_t i = 0; i < data->robots.size(); ++i) {
+            auto &message = data->robots[i].message;
+            if (message.empty()) continue;
+            startStatusTimer(data->robots.size() > 1 ? "Robot " + std::to_string(i + 1) + ": " + message : message, 200);
+            message.clear();
         }
 
         if (configureBoxVisible) {
@@ -408,10 +338,8 @@ namespace rb {
 
         //Clear all of the selected entity objects
         static auto clearSelectedEntityObjects = [&]() {
-            selectedEntityPoint = nullptr;
-            originalSelectedEntityPoint = nullptr;
-            selectedEntityLine = nullptr;
-            originalSelectedEntityLine = nullptr;
+            selectedEntityPoint = detail::ShapeHandle();
+            selectedEntityLine = detail::ShapeHandle();
         };
 
         //New map box
@@ -446,13 +374,12 @@ namespace rb {
                     newMapErrorText = "The map's tile height and tile width must be at least 1!";
                 } else if (mapTileSize >= 255) {
                     newMapErrorText = "The map's tile height and tile width must be at exceeded 255!";
-                } else if (mapSizeX >= 255 || mapSizeY >= 255) {
-                    newMapErrorText = "Maximum map size exceeded (255 sm)!";
+                } else if (mapSizeX > MAX_MAP_SIZE || mapSizeY > MAX_MAP_SIZE) {
+                    newMapErrorText = "Maximum map size exceeded (" + std::to_string(MAX_MAP_SIZE) + ")!";
                 } else {
                     clearSelectedEntityObjects();
                     this->_level.createMap(sf::Vector2i(mapSizeX, mapSizeY),
                                            sf::Vector2i(mapTileSize, mapTileSize));
-                    createGridLines();
                     newMapErrorText = "";
                     this->_currentWindowType = detail::WindowTypes::None;
                     this->_currentMapEditorMode = detail::MapEditorMode::Object;
@@ -479,22 +406,21 @@ namespace rb {
 
 
             auto fillLineSection = [&]() -> void {
-                int c = 0;
-                for (std::shared_ptr<detail::Shape> shape : this->_level.getShapeList()) {
-                    ++c;
+                for (const auto &entry : this->_level.getShapes()) {
                     //Line check
-                    auto l = std::dynamic_pointer_cast<detail::Line>(shape);
+                    auto l = dynamic_cast<detail::Line *>(entry.value.get());
                     if (l != nullptr) {
-                        std::string strId = "Line" + std::to_string(c);
+                        std::string strId = "Line" + std::to_string(entry.handle.index);
                         ImGui::PushID(strId.c_str());
-                        bool isSelected = (selectedEntityLine == l);
-                        shape->unselect();
+                        bool isSelected = (selectedEntityLine == entry.handle);
+                        if (l->isSelected()) {
+                            l->unselect();
+                            this->_level.invalidate();
+                        }
                         if (ImGui::Selectable(l->getName().c_str(), isSelected)) {
-                            selectedEntityLine = l;
-                            shape->select();
-                            originalSelectedEntityLine = std::make_shared<detail::Line>(l->getName(), l->getColor(),
-                                                                                        l->getPoints());
-
+                            selectedEntityLine = entry.handle;
+                            l->select();
+                            this->_level.invalidate();
                         }
 
                         if (isSelected)
@@ -505,7 +431,8 @@ namespace rb {
                 }
             };
 
-            if (ImGui::BeginCombo("Path", selectedEntityLine ? selectedEntityLine->getName().c_str() : "Select path")) {
+            auto playLine = this->_level.getShape<detail::Line>(selectedEntityLine);
+            if (ImGui::BeginCombo("Path", playLine ? playLine->getName().c_str() : "Select path")) {
                 fillLineSection();
                 ImGui::EndCombo();
             }
@@ -514,143 +441,20 @@ namespace rb {
 
 
             if (ImGui::Button("Play")) {
-                if (selectedEntityLine == nullptr) {
+                playLine = this->_level.getShape<detail::Line>(selectedEntityLine);
+                if (playLine == nullptr) {
                     newMapErrorText = "Select path!";
                 } else {
-                    inp->commands.clear();
-                    const auto &points = selectedEntityLine->getPoints();
-                    for (unsigned int i = 0; i < points.size() - 1; ++i) {
-
-                        sf::Vector2f point1 = sf::Vector2f(
-                                points[i]->getCircle().getPosition().x + points[i]->getCircle().getRadius(),
-                                points[i]->getCircle().getPosition().y + points[i]->getCircle().getRadius());
-                        sf::Vector2f point2 = sf::Vector2f(
-                                points[i + 1]->getCircle().getPosition().x + points[i + 1]->getCircle().getRadius(),
-                                points[i + 1]->getCircle().getPosition().y + points[i + 1]->getCircle().getRadius());
-
-                        sf::Vector2f direction = point2 - point1;
-
-                        sf::Vector2f unitDirection =
-                                direction / std::sqrt(direction.x * direction.x + direction.y * direction.y);
-
-                        sf::Vector2f unitPerpendicular(unitDirection.x, -unitDirection.y);
-
-                        // движение
-                        Command upCommand{};
-                        upCommand.size = this->_level.getTileSize().x;
-                        upCommand.direction = Direction::Up;
-                        upCommand.view = Direction::Up;
-
-
-                        // поворот робота
-                        Command directCommand{};
-                        directCommand.size = this->_level.getTileSize().x;
-                        directCommand.length = static_cast<int>(std::abs(direction.y)) / std::stof(
-                                detail::utils::getConfigValue(
-                                        "tile_scale_x")) / this->_level.getTileSize().x;
-
-                        if (unitPerpendicular.y > 0) {
-                            // поворот на верх
-                            directCommand.view = Direction::Up;
-                            upCommand.view = Direction::Up;
-
-                            upCommand.length = static_cast<int>(std::abs(direction.y)) / std::stof(
-                                    detail::utils::getConfigValue(
-                                            "tile_scale_x")) / this->_level.getTileSize().x;
-
-                            if (!inp->commands.empty()) {
-                                const auto &lastDirectCommand = inp->commands.back();
-
-                                if ((lastDirectCommand.view == Direction::Right)) {
-                                    // Поворот налево, в случае если смотрит на право
-                                    directCommand.direction = Direction::Left;
-                                    inp->commands.emplace_back(directCommand);
-                                } else if ((lastDirectCommand.view == Direction::Left)) {
-                                    // Поворот направо, в случае если смотрит на лево
-                                    directCommand.direction = Direction::Right;
-                                    inp->commands.emplace_back(directCommand);
-                                }
-                            }
-
-                        } else if (unitPerpendicular.y < 0) {
-                            // поворот на вниз
-                            directCommand.view = Direction::Down;
-                            upCommand.view = Direction::Down;
-
-                            upCommand.length = static_cast<int>(std::abs(direction.y)) / std::stof(
-                                    detail::utils::getConfigValue(
-                                            "tile_scale_x")) / this->_level.getTileSize().x;
-
-
-                            if (!inp->commands.empty()) {
-                                const auto &lastDirectCommand = inp->commands.back();
-
-                                if ((lastDirectCommand.view == Direction::Right)) {
-                                    // Поворот направо, в случае если смотрит на право
-                                    directCommand.direction = Direction::Right;
-                                    inp->commands.emplace_back(directCommand);
-                                } else if ((lastDirectCommand.view == Direction::Left)) {
-                                    // Поворот налево, в случае если смотрит на лево
-                                    directCommand.direction = Direction::Left;
-                                    inp->commands.emplace_back(directCommand);
-                                }
-                            }
-
-                        } else if (unitDirection.x > 0) {
-
-                            // поворот на право
-                            directCommand.view = Direction::Right;
-                            upCommand.view = Direction::Right;
-
-                            upCommand.length = static_cast<int>(std::abs(direction.x)) / std::stof(
-                                    detail::utils::getConfigValue(
-                                            "tile_scale_x")) / this->_level.getTileSize().x;
-
-
-                            if (!inp->commands.empty()) {
-                                const auto &lastDirectCommand = inp->commands.back();
-
-                                if ((lastDirectCommand.view == Direction::Up)) {
-                                    // Поворот направо, в случае если смотрит на верх
-                                    directCommand.direction = Direction::Right;
-                                    inp->commands.emplace_back(directCommand);
-                                } else if ((lastDirectCommand.view == Direction::Down)) {
-                                    // Поворот налево, в случае если смотрит вниз
-                                    directCommand.direction = Direction::Left;
-                                    inp->commands.emplace_back(directCommand);
-                                }
-                            }
-                        } else if (unitDirection.x < 0) {
-
-                            // поворот на право
-                            directCommand.view = Direction::Left;
-                            upCommand.view = Direction::Left;
-
-                            upCommand.length = static_cast<int>(std::abs(direction.x)) / std::stof(
-                                    detail::utils::getConfigValue(
-                                            "tile_scale_x")) / this->_level.getTileSize().x;
-
-
-                            if (!inp->commands.empty()) {
-                                const auto &lastDirectCommand = inp->commands.back();
-
-                                if ((lastDirectCommand.view == Direction::Up)) {
-                                    // Поворот налево, в случае если смотрит на верх
-                                    directCommand.direction = Direction::Left;
-                                    inp->commands.emplace_back(directCommand);
-                                } else if ((lastDirectCommand.view == Direction::Down)) {
-                                    // Поворот направо, в случае если смотрит вниз
-                                    directCommand.direction = Direction::Right;
-                                    inp->commands.emplace_back(directCommand);
-                                }
-                            }
-                        }
-                        inp->commands.emplace_back(upCommand);
+                    const auto &points = playLine->getWaypoints();
+                    auto commands = PathCompiler(this->_level.getTileSize().x).compile(points.getX(), points.getY());
+                    if (commands.empty()) {
+                        newMapErrorText = "Path is empty!";
+                    } else {
+                        inp->route.publish(std::move(commands));
+                        this->_currentWindowType = detail::WindowTypes::None;
+                        if (auto &c = _data->callbacks[BUTTON_PLAY]) c();
+                        playBoxVisible = false;
                     }
-
-                    this->_currentWindowType = detail::WindowTypes::None;
-                    if (auto &c = _data->callbacks[BUTTON_PLAY]) c();
-                    playBoxVisible = false;
                 }
             }
             ImGui::SameLine();
@@ -675,23 +479,18 @@ namespace rb {
 
             //FillPointSection function
             auto fillPointSection = [&]() -> void {
-                int c = 0;
-                for (std::shared_ptr<detail::Shape> shape : this->_level.getShapeList()) {
-                    ++c;
+                for (const auto &entry : this->_level.getShapes()) {
                     //Point check
-                    auto p = std::dynamic_pointer_cast<detail::Point>(shape);
+                    auto p = dynamic_cast<detail::Point *>(entry.value.get());
                     if (p != nullptr) {
-                        std::string strId = "Point" + std::to_string(c);
+                        std::string strId = "Point" + std::to_string(entry.handle.index);
                         ImGui::PushID(strId.c_str());
                         if (ImGui::Selectable(p->getName().c_str())) {
                             entityPropertiesLoaded = false;
-                            shape->select();
-                            selectedEntityPoint = p;
-                            originalSelectedEntityPoint = std::make_shared<detail::Point>(p->getName(), p->getColor(),
-                                                                                          p->getCircle());
-
-                            selectedEntityLine = nullptr;
-                            originalSelectedEntityLine = nullptr;
+                            p->select();
+                            this->_level.invalidate();
+                            selectedEntityPoint = entry.handle;
+                            selectedEntityLine = detail::ShapeHandle();
 
                             //Show the properties window
                             showEntityProperties = true;
@@ -703,23 +502,18 @@ namespace rb {
             };
             //FillLineSection function
             auto fillLineSection = [&]() -> void {
-                int c = 0;
-                for (std::shared_ptr<detail::Shape> shape : this->_level.getShapeList()) {
-                    ++c;
+                for (const auto &entry : this->_level.getShapes()) {
                     //Line check
-                    auto l = std::dynamic_pointer_cast<detail::Line>(shape);
+                    auto l = dynamic_cast<detail::Line *>(entry.value.get());
                     if (l != nullptr) {
-                        std::string strId = "Line" + std::to_string(c);
+                        std::string strId = "Line" + std::to_string(entry.handle.index);
                         ImGui::PushID(strId.c_str());
                         if (ImGui::Selectable(l->getName().c_str())) {
                             entityPropertiesLoaded = false;
-                            shape->select();
-                            selectedEntityLine = l;
-                            originalSelectedEntityLine = std::make_shared<detail::Line>(l->getName(), l->getColor(),
-                                                                                        l->getPoints());
-
-                            selectedEntityPoint = nullptr;
-                            originalSelectedEntityPoint = nullptr;
+                            l->select();
+                            this->_level.invalidate();
+                            selectedEntityLine = entry.handle;
+                            selectedEntityPoint = detail::ShapeHandle();
 
                             //Show the properties window
                             showEntityProperties = true;
@@ -752,17 +546,103 @@ namespace rb {
             ImGui::End();
         };
 
+        /*
+         * Metrics
+         */
+        if (metricsVisible) {
+            static const char *names[] = {"Command round trip", "Core queue wait", "Core input", "Editor frame",
+                                          "Display"};
+            auto &metrics = detail::Metrics::instance();
+            detail::Histogram *histograms[] = {&metrics.commandRtt, &metrics.queueWait, &metrics.coreInput,
+                                               &metrics.frameTime, &metrics.displayTime};
+
+            ImGui::SetNextWindowSize(ImVec2(460, 0));
+            ImGui::Begin("Metrics", &metricsVisible, ImGuiWindowFlags_NoCollapse);
+            ImGui::Columns(5, "metrics");
+            ImGui::Text("ms");
+            ImGui::NextColumn();
+            ImGui::Text("count");
+            ImGui::NextColumn();
+            ImGui::Text("p50");
+            ImGui::NextColumn();
+            ImGui::Text("p99");
+            ImGui::NextColumn();
+            ImGui::Text("max");
+            ImGui::NextColumn();
+            ImGui::Separator();
+            for (std::size_t i = 0; i < sizeof(histograms) / sizeof(histograms[0]); ++i) {
+                const auto summary = histograms[i]->summary();
+                ImGui::Text("%s", names[i]);
+                ImGui::NextColumn();
+                ImGui::Text("%llu", static_cast<unsigned long long>(summary.count));
+                ImGui::NextColumn();
+                ImGui::Text("%.3f", summary.p50 / 1e6);
+                ImGui::NextColumn();
+                ImGui::Text("%.3f", summary.p99 / 1e6);
+                ImGui::NextColumn();
+                ImGui::Text("%.3f", summary.max / 1e6);
+                ImGui::NextColumn();
+            }
+            ImGui::Columns(1);
+            ImGui::Separator();
+            if (ImGui::Button("Reset")) {
+                for (auto histogram : histograms) histogram->reset();
+            }
+
+            // Clicks on the window must not reach the map
+            if (ImGui::IsWindowHovered()) {
+                this->_currentWindowType = detail::WindowTypes::MetricsWindow;
+            } else if (this->_currentWindowType == detail::WindowTypes::MetricsWindow) {
+                this->_currentWindowType = detail::WindowTypes::None;
+            }
+            ImGui::End();
+        }
+        if (!metricsVisible && this->_currentWindowType == detail::WindowTypes::MetricsWindow) {
+            this->_currentWindowType = detail::WindowTypes::None;
+        }
+
+        //Select the shape of the waypoint under the mouse
+        if (!this->_hideShapes && this->_currentDrawShape == detail::DrawShapes::None &&
+            this->_currentMapEditorMode == detail::MapEditorMode::Object &&
+            (this->_currentWindowType == detail::WindowTypes::None ||
+             this->_currentWindowType == detail::WindowTypes::EntityPropertiesWindow) &&
+            !ImGui::GetIO().WantCaptureMouse &&
+            this->_currentEvent.type == sf::Event::MouseButtonReleased &&
+            this->_currentEvent.mouseButton.button == sf::Mouse::Left) {
+            auto hit = this->_level.pick(mousePos);
+            if (hit.shape.valid()) {
+                if (auto shape = this->_level.getShape(selectedEntityPoint)) shape->unselect();
+                if (auto shape = this->_level.getShape(selectedEntityLine)) shape->unselect();
+
+                auto shape = this->_level.getShape(hit.shape);
+                shape->select();
+                this->_level.invalidate();
+                clearSelectedEntityObjects();
+                if (dynamic_cast<detail::Point *>(shape) != nullptr) {
+                    selectedEntityPoint = hit.shape;
+                } else {
+                    selectedEntityLine = hit.shape;
+                }
+                entityPropertiesLoaded = false;
+                showEntityProperties = true;
+            }
+            this->_currentEvent = sf::Event();
+        }
+
         if (showEntityProperties) {
 
             ImGui::SetNextWindowSize(ImVec2(511, 234));
             this->_currentWindowType = detail::WindowTypes::EntityPropertiesWindow;
             ImGui::Begin("Properties", nullptr, ImGuiWindowFlags_AlwaysAutoResize |
                                                 ImGuiWindowFlags_HorizontalScrollbar);
+            auto selectedPoint = this->_level.getShape<detail::Point>(selectedEntityPoint);
+            auto selectedLine = this->_level.getShape<detail::Line>(selectedEntityLine);
+
             ImGui::PushID("SelectedEntityName");
             static char name[500] = "";
             if (!entityPropertiesLoaded) {
-                strcpy(name, selectedEntityPoint != nullptr ? selectedEntityPoint->getName().c_str() :
-                             selectedEntityLine != nullptr ? selectedEntityLine->getName().c_str() :
+                strcpy(name, selectedPoint != nullptr ? selectedPoint->getName().c_str() :
+                             selectedLine != nullptr ? selectedLine->getName().c_str() :
                              "");
             }
             ImGui::PushItemWidth(200);
@@ -774,31 +654,38 @@ namespace rb {
 
 
             //List all of the points (with an option to delete)
-            if (selectedEntityLine != nullptr) {
+            if (selectedLine != nullptr) {
                 ImGui::Text("Points");
-                for (auto &p : selectedEntityLine->getPoints()) {
-                    ImGui::Text(p->getName().c_str());
-                    if (selectedEntityLine->getPoints().size() > 2) {
+                const auto &waypoints = selectedLine->getWaypoints();
+                std::size_t deletedPoint = waypoints.size();
+                for (std::size_t i = 0; i < waypoints.size(); ++i) {
+                    const auto &pointName = detail::NameTable::instance().get(waypoints.getName(i));
+                    ImGui::Text(pointName.c_str());
+                    if (waypoints.size() > 2) {
                         ImGui::SameLine();
-                        ImGui::PushID(("btn_" + p->getName()).c_str());
+                        ImGui::PushID(("btn_" + pointName).c_str());
                         if (ImGui::Button("x", ImVec2(26, 20))) {
-                            selectedEntityLine->deletePoint(p);
+                            deletedPoint = i;
                         }
                         ImGui::PopID();
                     }
                 }
+                if (deletedPoint < waypoints.size()) {
+                    selectedLine->deleteWaypoint(deletedPoint);
+                    this->_level.updateShape(selectedEntityLine);
+                }
             }
 
             if (ImGui::Button("Update")) {
-                if (selectedEntityPoint != nullptr) {
-                    selectedEntityPoint->setName(name);
-                    selectedEntityPoint->unselect();
-                    this->_level.updateShape(originalSelectedEntityPoint, selectedEntityPoint);
+                if (selectedPoint != nullptr) {
+                    selectedPoint->setName(name);
+                    selectedPoint->unselect();
+                    this->_level.updateShape(selectedEntityPoint);
                     startStatusTimer("Point saved successfully!", 200);
-                } else if (selectedEntityLine != nullptr) {
-                    selectedEntityLine->setName(name);
-                    selectedEntityLine->unselect();
-                    this->_level.updateShape(originalSelectedEntityLine, selectedEntityLine);
+                } else if (selectedLine != nullptr) {
+                    selectedLine->setName(name);
+                    selectedLine->unselect();
+                    this->_level.updateShape(selectedEntityLine);
                     startStatusTimer("Line saved successfully!", 200);
                 }
                 this->_currentWindowType = detail::WindowTypes::None;
@@ -806,11 +693,12 @@ namespace rb {
             }
             ImGui::SameLine();
             if (ImGui::Button("Close")) {
-                if (selectedEntityPoint != nullptr) {
-                    selectedEntityPoint->unselect();
-                } else if (selectedEntityLine != nullptr) {
-                    selectedEntityLine->unselect();
+                if (selectedPoint != nullptr) {
+                    selectedPoint->unselect();
+                } else if (selectedLine != nullptr) {
+                    selectedLine->unselect();
                 }
+                this->_level.invalidate();
                 this->_currentWindowType = detail::WindowTypes::None;
                 showEntityProperties = false;
             }
@@ -818,11 +706,8 @@ namespace rb {
             ImGui::Text("    ");
             ImGui::SameLine();
             if (ImGui::Button("Delete")) {
-                if (selectedEntityPoint != nullptr) {
-                    this->_level.removeShape(selectedEntityPoint);
-                } else if (selectedEntityLine != nullptr) {
-                    this->_level.removeShape(selectedEntityLine);
-                }
+                this->_level.removeShape(selectedEntityPoint);
+                this->_level.removeShape(selectedEntityLine);
                 clearSelectedEntityObjects();
                 this->_currentWindowType = detail::WindowTypes::None;
                 showEntityProperties = false;
@@ -834,17 +719,17 @@ namespace rb {
         if (ImGui::BeginMainMenuBar()) {
             if (ImGui::BeginMenu("Configure")) {
 
-                if (ImGui::MenuItem("Connect", nullptr, false, data->statusConnection == StatusConnection::Closed)) {
+                if (ImGui::MenuItem("Connect", nullptr, false, robot.statusConnection == StatusConnection::Closed)) {
                     configureBoxVisible = true;
                 }
                 if (ImGui::MenuItem("Disconnect", nullptr, false,
-                                    data->statusConnection == StatusConnection::Connected)) {
+                                    robot.statusConnection == StatusConnection::Connected)) {
                     if (auto &c = _data->callbacks[BUTTON_DISCONNECT]) c();
                 }
                 ImGui::EndMenu();
             }
 
-            if (ImGui::BeginMenu("Control", data->statusConnection == StatusConnection::Connected)) {
+            if (ImGui::BeginMenu("Control", robot.statusConnection == StatusConnection::Connected)) {
                 if (ImGui::MenuItem("Play")) {
                     playBoxVisible = true;
                 }
@@ -854,8 +739,28 @@ namespace rb {
                 ImGui::EndMenu();
             }
 
+            if (ImGui::BeginMenu("View")) {
+                ImGui::MenuItem("Metrics", nullptr, &metricsVisible);
+                ImGui::EndMenu();
+            }
+
+            if (data->robots.size() > 1 && ImGui::BeginMenu("Robot")) {
+                for (std::size_t i = 0; i < data->robots.size(); ++i) {
+                    std::string label = "Robot " + std::to_string(i + 1);
+                    if (data->robots[i].statusControl == StatusControl::Play) {
+                        label += " (playing)";
+                    } else if (data->robots[i].statusConnection == StatusConnection::Connected) {
+                        label += " (connected)";
+                    }
+                    if (ImGui::MenuItem(label.c_str(), nullptr, inp->robot == static_cast<int>(i))) {
+                        inp->robot = static_cast<int>(i);
+                    }
+                }
+                ImGui::EndMenu();
+            }
+
 
-            if (ImGui::BeginMenu("Map", data->statusControl == StatusControl::Stop && this->_menuClicks <= 1)) {
+            if (ImGui::BeginMenu("Map", robot.statusControl == StatusControl::Stop && this->_menuClicks <= 1)) {
                 if (ImGui::MenuItem("New map")) {
                     newMapBoxVisible = true;
                 }
@@ -877,7 +782,7 @@ namespace rb {
                 ImGui::Separator();
                 if (ImGui::Checkbox("Show entity list   E", &cbShowEntityList) &&
                     this->_currentMapEditorMode == detail::MapEditorMode::Object &&
-                    data->statusControl == StatusControl::Stop) {
+                    robot.statusControl == StatusControl::Stop) {
                     this->_showEntityList = cbShowEntityList;
                 }
                 if (ImGui::Checkbox("Hide shapes", &cbHideShapes)) {
@@ -924,6 +829,13 @@ namespace rb {
             ImGui::GetWindowDrawList()->AddText(
                     ImVec2(this->_window->getSize().x - 80, this->_window->getSize().y - 22),
                     ImColor(1.0f, 1.0f, 1.0f, 1.0f), ss.str().c_str());
+
+            //Drawn and culled primitives
+            const auto &stats = this->_shapeRenderer.getStats();
+            std::string primitives = "drawn " + std::to_string(stats.drawn) + " / culled " + std::to_string(stats.culled);
+            ImGui::GetWindowDrawList()->AddText(
+                    ImVec2(this->_window->getSize().x - 300, this->_window->getSize().y - 22),
+                    ImColor(0.6f, 0.6f, 0.6f, 1.0f), primitives.c_str());
         }
         if (showCurrentStatus) {
             ImGui::GetWindowDrawList()->AddText(ImVec2(10, this->_window->getSize().y - 22),
@@ -938,6 +850,7 @@ namespace rb {
         } else {
             showCurrentStatus = false;
         }
+        this->_statusActive = showCurrentStatus;
 
         ImGui::Render();
 
@@ -947,7 +860,12 @@ namespace rb {
         ImGui::SFML::Update(t);
         //Updating internal classes
         this->_level.update(t.asSeconds());
-        this->_graphics->update(t.asSeconds(), sf::Vector2f(this->_level.getTileSize()), (this->_windowHasFocus));
+        this->_cameraMoved = this->_graphics->update(t.asSeconds(), sf::Vector2f(this->_level.getTileSize()),
+                                                     (this->_windowHasFocus));
+    }
+
+    bool Editor::isAnimating() const {
+        return this->_cameraMoved || this->_statusActive;
     }
 
     void Editor::exit() {
@@ -992,38 +910,6 @@ namespace rb {
         }
     }
 
-    void Editor::createGridLines() {
-        this->_gridLines.clear();
-        std::array<sf::Vertex, 2> line;
-
-        //Horizontal lines
-        for (int i = 0; i < this->_level.getSize().y + 1; ++i) {
-            line = {
-                    sf::Vertex(sf::Vector2f(0, i * (this->_level.getTileSize().y * std::stof(
-                            detail::utils::getConfigValue("tile_scale_y"))))),
-                    sf::Vertex(sf::Vector2f(this->_level.getSize().x * this->_level.getTileSize().x *
-                                            std::stof(detail::utils::getConfigValue("tile_scale_x")),
-                                            i * (this->_level.getTileSize().y *
-                                                 std::stof(detail::utils::getConfigValue("tile_scale_y")))))
-            };
-            this->_gridLines.push_back(line);
-        }
-
-        //Vertical lines
-        for (int i = 0; i < this->_level.getSize().x + 1; ++i) {
-            line = {
-                    sf::Vertex(sf::Vector2f(i * (this->_level.getTileSize().x * std::stof(
-                            detail::utils::getConfigValue("tile_scale_x"))), 0)),
-                    sf::Vertex(sf::Vector2f(i * this->_level.getTileSize().x *
-                                            std::stof(detail::utils::getConfigValue("tile_scale_x")),
-                                            this->_level.getSize().y * (this->_level.getTileSize().y *
-                                                                        std::stof(detail::utils::getConfigValue(
-                                                                                "tile_scale_y")))))
-            };
-            this->_gridLines.push_back(line);
-        }
-    }
-
     void Editor::setStateData(std::weak_ptr<StateData> stateData) {
         _data->stateData = stateData;
     }
@@ -6,6 +6,7 @@
 #include <string>
 #include <functional>
 #include "detail.h"
+#include "renderer.h"
 
 namespace rb {
 
@@ -20,6 +21,9 @@ namespace rb {
         void update(sf::Time elapsedTime);
         void exit();
 
+        // True while something on screen changes without user input (status timer, camera panning)
+        bool isAnimating() const;
+
         void processEvent(sf::Event &event);
 
         void setStateData(std::weak_ptr<StateData> stateData);
@@ -36,20 +40,22 @@ namespace rb {
         void setEventCallback(Event e, std::function<void()> && callback);
 
     private:
-        void createGridLines();
-
         bool _showGridLines;
         bool _windowHasFocus;
         bool _hideShapes;
         bool _showEntityList;
         bool _attachPoint;
+        bool _cameraMoved;
+        bool _statusActive;
 
         int _menuClicks;
 
         sf::RenderWindow* _window;
         std::shared_ptr<rb::detail::Graphics>  _graphics;
-        std::vector<std::array<sf::Vertex, 2>> _gridLines;
         detail::Level _level;
+        detail::GridRenderer _gridRenderer;
+        detail::ShapeRenderer _shapeRenderer;
+        detail::ShapeBatch _previewBatch;
         detail::WindowTypes _currentWindowType;
         detail::MapEditorMode _currentMapEditorMode;
         detail::DrawShapes _currentDrawShape;
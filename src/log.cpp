@@ -0,0 +1,273 @@
+#include "log.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace rb {
+    namespace detail {
+
+        namespace {
+            const char *levelName(LogLevel level) {
+                switch (level) {
+                    case LogLevel::Trace:
+                        return "TRACE";
+                    case LogLevel::Debug:
+                        return "DEBUG";
+                    case LogLevel::Info:
+                        return "INFO ";
+                    case LogLevel::Warn:
+                        return "WARN ";
+                    default:
+                        return "ERROR";
+                }
+            }
+
+            // Marks the ring of a thread as orphaned when the thread exits
+            struct RingOwner {
+                std::shared_ptr<LogRing> ring;
+
+                ~RingOwner() {
+                    if (ring) ring->orphaned = true;
+                }
+            };
+
+            thread_local RingOwner ringOwner;
+        }
+
+        const std::size_t LogRecord::MAX_ARGS;
+        const std::size_t LogRecord::TEXT_SIZE;
+        const std::size_t LogRing::CAPACITY;
+
+        Logger &Logger::instance() {
+            static Logger logger;
+            return logger;
+        }
+
+        Logger::Logger() : _start(now()) {
+            this->_worker = std::thread(&Logger::workerMain, this);
+        }
+
+        Logger::~Logger() {
+            {
+                std::lock_guard<std::mutex> lock(this->_workerMutex);
+                this->_running = false;
+            }
+            this->_workerCondVar.notify_all();
+            if (this->_worker.joinable()) this->_worker.join();
+            if (this->_file != nullptr) std::fclose(this->_file);
+        }
+
+        LogLevel Logger::parseLevel(const std::string &name, LogLevel def) {
+            if (name == "trace") return LogLevel::Trace;
+            if (name == "debug") return LogLevel::Debug;
+            if (name == "info") return LogLevel::Info;
+            if (name == "warn") return LogLevel::Warn;
+            if (name == "error") return LogLevel::Error;
+            if (name == "off") return LogLevel::Off;
+            return def;
+        }
+
+        void Logger::setLevel(LogLevel level) {
+            this->_level = level;
+        }
+
+        LogLevel Logger::getLevel() const {
+            return this->_level;
+        }
+
+        bool Logger::setFile(const std::string &path) {
+            std::FILE *file = nullptr;
+            if (!path.empty()) {
+                file = std::fopen(path.c_str(), "a");
+                if (file == nullptr) return false;
+            }
+
+            std::lock_guard<std::mutex> lock(this->_sinkMutex);
+            if (this->_file != nullptr) std::fclose(this->_file);
+            this->_file = file;
+            return true;
+        }
+
+        void Logger::flush() {
+            std::unique_lock<std::mutex> lock(this->_workerMutex);
+            const std::uint64_t request = ++this->_flushRequested;
+            this->_workerCondVar.notify_all();
+            this->_flushCondVar.wait(lock, [this, request] { return this->_flushDone >= request || !this->_running; });
+        }
+
+        std::size_t Logger::getDropped() const {
+            return this->_dropped;
+        }
+
+        std::uint64_t Logger::now() {
+            return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        void Logger::append(LogRecord &record, double value) {
+            std::uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            appendValue(record, LogRecord::Float, bits);
+        }
+
+        void Logger::append(LogRecord &record, const char *value) {
+            appendText(record, LogRecord::Text, value, value == nullptr ? 0 : std::strlen(value));
+        }
+
+        void Logger::append(LogRecord &record, const std::string &value) {
+            appendText(record, LogRecord::Text, value.data(), value.size());
+        }
+
+        void Logger::append(LogRecord &record, const LogBytes &value) {
+            appendText(record, LogRecord::Bytes, static_cast<const char *>(value.data), value.size);
+        }
+
+        void Logger::appendValue(LogRecord &record, LogRecord::ArgType type, std::uint64_t value) {
+            if (record.count == LogRecord::MAX_ARGS) return;
+            record.types[record.count] = type;
+            record.args[record.count] = value;
+            ++record.count;
+        }
+
+        void Logger::appendText(LogRecord &record, LogRecord::ArgType type, const char *data, std::size_t size) {
+            // Longer texts are cut, the record has a fixed size
+            size = std::min(size, LogRecord::TEXT_SIZE - record.textSize);
+            if (size > 0) std::memcpy(record.text.data() + record.textSize, data, size);
+            appendValue(record, type, static_cast<std::uint64_t>(record.textSize) << 16 | size);
+            record.textSize = static_cast<std::uint8_t>(record.textSize + size);
+        }
+
+        void Logger::format(const LogRecord &record, std::string &line) const {
+            static const char hex[] = "0123456789abcdef";
+
+            char prefix[32];
+            const double seconds = record.time > this->_start ? (record.time - this->_start) / 1e9 : 0.0;
+            std::snprintf(prefix, sizeof(prefix), "%12.6f %s ", seconds, levelName(record.level));
+            line += prefix;
+
+            std::size_t arg = 0;
+            for (const char *c = record.format; *c != '\0'; ++c) {
+                if (c[0] != '{' || c[1] != '}' || arg >= record.count) {
+                    line += *c;
+                    continue;
+                }
+                ++c;
+
+                const std::uint64_t value = record.args[arg];
+                char number[32];
+                switch (record.types[arg++]) {
+                    case LogRecord::Int:
+                        std::snprintf(number, sizeof(number), "%lld", static_cast<long long>(value));
+                        line += number;
+                        break;
+                    case LogRecord::Uint:
+                        std::snprintf(number, sizeof(number), "%llu", static_cast<unsigned long long>(value));
+                        line += number;
+                        break;
+                    case LogRecord::Float: {
+                        double d;
+                        std::memcpy(&d, &value, sizeof(d));
+                        std::snprintf(number, sizeof(number), "%g", d);
+                        line += number;
+                    }
+                        break;
+                    case LogRecord::Text:
+                        line.append(record.text.data() + (value >> 16), value & 0xFFFF);
+                        break;
+                    case LogRecord::Bytes:
+                        for (std::size_t i = 0; i < (value & 0xFFFF); ++i) {
+                            const auto byte = static_cast<std::uint8_t>(record.text[(value >> 16) + i]);
+                            if (i > 0) line += ' ';
+                            line += hex[byte >> 4];
+                            line += hex[byte & 0xF];
+                        }
+                        break;
+                }
+            }
+            line += '\n';
+        }
+
+        LogRecord *Logger::reserve(LogRing &ring) {
+            const std::size_t tail = ring.tail.load(std::memory_order_relaxed);
+            if (tail - ring.head.load(std::memory_order_acquire) == LogRing::CAPACITY) {
+                this->_dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            return &ring.records[tail % LogRing::CAPACITY];
+        }
+
+        LogRing &Logger::threadRing() {
+            if (!ringOwner.ring) {
+                ringOwner.ring = std::make_shared<LogRing>();
+                std::lock_guard<std::mutex> lock(this->_ringsMutex);
+                this->_rings.push_back(ringOwner.ring);
+            }
+            return *ringOwner.ring;
+        }
+
+        bool Logger::drain(std::vector<LogRecord> &batch, std::string &line) {
+            batch.clear();
+            {
+                std::lock_guard<std::mutex> lock(this->_ringsMutex);
+                for (auto it = this->_rings.begin(); it != this->_rings.end();) {
+                    LogRing &ring = **it;
+                    // Read orphaned first, a record pushed before the thread exited is then visible
+                    const bool orphaned = ring.orphaned.load();
+                    const std::size_t tail = ring.tail.load(std::memory_order_acquire);
+                    std::size_t head = ring.head.load(std::memory_order_relaxed);
+                    for (; head != tail; ++head) {
+                        batch.push_back(ring.records[head % LogRing::CAPACITY]);
+                    }
+                    ring.head.store(head, std::memory_order_release);
+
+                    if (orphaned) {
+                        it = this->_rings.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+            if (batch.empty()) return false;
+
+            // Rings are drained one after another, restore the order of the calls
+            std::stable_sort(batch.begin(), batch.end(), [](const LogRecord &a, const LogRecord &b) {
+                return a.time < b.time;
+            });
+
+            line.clear();
+            for (const auto &record : batch) {
+                format(record, line);
+            }
+
+            std::lock_guard<std::mutex> lock(this->_sinkMutex);
+            std::FILE *out = this->_file != nullptr ? this->_file : stdout;
+            std::fwrite(line.data(), 1, line.size(), out);
+            std::fflush(out);
+            return true;
+        }
+
+        void Logger::workerMain() {
+            std::vector<LogRecord> batch;
+            std::string line;
+            batch.reserve(LogRing::CAPACITY);
+
+            std::unique_lock<std::mutex> lock(this->_workerMutex);
+            while (true) {
+                const bool running = this->_running;
+                const std::uint64_t request = this->_flushRequested;
+                lock.unlock();
+
+                while (this->drain(batch, line)) {
+                }
+
+                lock.lock();
+                this->_flushDone = request;
+                this->_flushCondVar.notify_all();
+                if (!running) break;
+                this->_workerCondVar.wait_for(lock, std::chrono::milliseconds(5), [this, request] {
+                    return !this->_running || this->_flushRequested != request;
+                });
+            }
+        }
+    }
+}
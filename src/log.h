@@ -0,0 +1,203 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace rb {
+    namespace detail {
+
+        enum class LogLevel : std::uint8_t {
+            Trace,
+            Debug,
+            Info,
+            Warn,
+            Error,
+            Off
+        };
+
+        // Logged as hex, only the first bytes which fit into the record are kept
+        struct LogBytes {
+            const void *data;
+            std::size_t size;
+        };
+
+        /*
+         * One log call. Arguments are stored as raw values and formatted later on the logger
+         * thread, strings are copied into the record because they may not outlive the call.
+         */
+        struct LogRecord {
+            static const std::size_t MAX_ARGS = 6;
+            static const std::size_t TEXT_SIZE = 96;
+
+            enum ArgType : std::uint8_t {
+                Int,
+                Uint,
+                Float,
+                Text,
+                Bytes
+            };
+
+            std::uint64_t time;
+            // Must be a string literal, "{}" is replaced by the next argument
+            const char *format;
+            LogLevel level;
+            std::uint8_t count;
+            std::uint8_t textSize;
+            std::array<ArgType, MAX_ARGS> types;
+            // Values, or offset << 16 | size of the text for Text and Bytes
+            std::array<std::uint64_t, MAX_ARGS> args;
+            std::array<char, TEXT_SIZE> text;
+        };
+
+        /*
+         * Single producer single consumer queue of records owned by one thread
+         */
+        struct LogRing {
+            static const std::size_t CAPACITY = 1024;
+
+            std::array<LogRecord, CAPACITY> records;
+            std::atomic<std::size_t> head{0};
+            std::atomic<std::size_t> tail{0};
+            // Set when the owning thread exits, the ring is removed once it is drained
+            std::atomic<bool> orphaned{false};
+        };
+
+        /*
+         * Asynchronous logger. A log call copies its arguments into a ring buffer of the calling
+         * thread without locking, a background thread formats the records and writes them to
+         * stdout or a file. Records are dropped if a ring is full, so logging never blocks.
+         */
+        class Logger {
+        public:
+            static Logger &instance();
+
+            ~Logger();
+
+            static LogLevel parseLevel(const std::string &name, LogLevel def = LogLevel::Info);
+
+            void setLevel(LogLevel level);
+
+            LogLevel getLevel() const;
+
+            bool enabled(LogLevel level) const {
+                return level >= this->_level.load(std::memory_order_relaxed);
+            }
+
+            // Writes to the file instead of stdout, an empty path switches back to stdout.
+            // Returns false if the file could not be opened.
+            bool setFile(const std::string &path);
+
+            // Blocks until every record logged before the call is written
+            void flush();
+
+            // Records dropped because a ring was full
+            std::size_t getDropped() const;
+
+            template<class... Args>
+            void write(LogLevel level, const char *format, const Args &... args) {
+                // The record is filled in place, nothing is copied after the arguments
+                LogRing &ring = this->threadRing();
+                LogRecord *record = this->reserve(ring);
+                if (record == nullptr) return;
+                record->time = now();
+                record->format = format;
+                record->level = level;
+                record->count = 0;
+                record->textSize = 0;
+                int expand[] = {0, (append(*record, args), 0)...};
+                (void) expand;
+                ring.tail.store(ring.tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+
+        private:
+            Logger();
+
+            Logger(const Logger &) = delete;
+
+            Logger &operator=(const Logger &) = delete;
+
+            static std::uint64_t now();
+
+            template<class T>
+            static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+            append(LogRecord &record, T value) {
+                appendValue(record, LogRecord::Int, static_cast<std::uint64_t>(static_cast<std::int64_t>(value)));
+            }
+
+            template<class T>
+            static typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+            append(LogRecord &record, T value) {
+                appendValue(record, LogRecord::Uint, static_cast<std::uint64_t>(value));
+            }
+
+            template<class T>
+            static typename std::enable_if<std::is_enum<T>::value>::type
+            append(LogRecord &record, T value) {
+                appendValue(record, LogRecord::Int, static_cast<std::uint64_t>(static_cast<std::int64_t>(value)));
+            }
+
+            static void append(LogRecord &record, double value);
+
+            static void append(LogRecord &record, const char *value);
+
+            static void append(LogRecord &record, const std::string &value);
+
+            static void append(LogRecord &record, const LogBytes &value);
+
+            static void appendValue(LogRecord &record, LogRecord::ArgType type, std::uint64_t value);
+
+            static void appendText(LogRecord &record, LogRecord::ArgType type, const char *data, std::size_t size);
+
+            void format(const LogRecord &record, std::string &line) const;
+
+            // Returns the free slot of the ring or nullptr if the ring is full
+            LogRecord *reserve(LogRing &ring);
+
+            LogRing &threadRing();
+
+            void workerMain();
+
+            // Moves the records of all rings to the sink, returns false if there were none
+            bool drain(std::vector<LogRecord> &batch, std::string &line);
+
+            std::uint64_t _start;
+            std::atomic<LogLevel> _level{LogLevel::Info};
+            std::atomic<std::size_t> _dropped{0};
+
+            std::mutex _ringsMutex;
+            std::vector<std::shared_ptr<LogRing>> _rings;
+
+            std::mutex _sinkMutex;
+            std::FILE *_file = nullptr;
+
+            std::mutex _workerMutex;
+            std::condition_variable _workerCondVar;
+            std::condition_variable _flushCondVar;
+            std::uint64_t _flushRequested = 0;
+            std::uint64_t _flushDone = 0;
+            bool _running = true;
+            std::thread _worker;
+        };
+    }
+}
+
+#define RB_LOG(level, ...) \
+    do { \
+        auto &rbLogger = ::rb::detail::Logger::instance(); \
+        if (rbLogger.enabled(level)) rbLogger.write(level, __VA_ARGS__); \
+    } while (0)
+
+#define RB_LOG_TRACE(...) RB_LOG(::rb::detail::LogLevel::Trace, __VA_ARGS__)
+#define RB_LOG_DEBUG(...) RB_LOG(::rb::detail::LogLevel::Debug, __VA_ARGS__)
+#define RB_LOG_INFO(...) RB_LOG(::rb::detail::LogLevel::Info, __VA_ARGS__)
+#define RB_LOG_WARN(...) RB_LOG(::rb::detail::LogLevel::Warn, __VA_ARGS__)
+#define RB_LOG_ERROR(...) RB_LOG(::rb::detail::LogLevel::Error, __VA_ARGS__)
@@ -1,11 +1,28 @@
 
 #include <iostream>
+#include <chrono>
 #include <SFML/Graphics.hpp>
 #include "editor.h"
 #include "core.h"
+#include "config.h"
+#include "log.h"
+#include "metrics.h"
 
 int main() {
 
+    auto &config = rb::detail::Config::instance();
+    if (!config.load("rembot.config")) {
+        std::cerr << "Failed to load rembot.config, using defaults" << std::endl;
+    } else if (config.getInt("config_hot_reload") != 0) {
+        config.watch();
+    }
+
+    auto &logger = rb::detail::Logger::instance();
+    logger.setLevel(rb::detail::Logger::parseLevel(config.getString("log_level", "info")));
+    if (!logger.setFile(config.getString("log_file"))) {
+        std::cerr << "Failed to open the log file, logging to stdout" << std::endl;
+    }
+
     sf::RenderWindow window(sf::VideoMode(800, 600), "rembot", sf::Style::Titlebar | sf::Style::Close);
 
     window.setVerticalSyncEnabled(true);
@@ -25,24 +42,58 @@ int main() {
 
     core->init();
 
+    // In on demand mode a frame is rendered only after input, a new core state or while
+    // the editor animates. A few more frames follow so ImGui can settle hover/active states.
+    const bool renderOnDemand = config.getString("render_mode") == "on_demand";
+    const int settleFrames = 3;
+    const auto idleTimeout = std::chrono::milliseconds(10);
+    int pendingFrames = settleFrames;
+
     while (window.isOpen()) {
+        bool redraw = !renderOnDemand || editor.isAnimating();
+
         sf::Event event{};
         while (window.pollEvent(event)) {
             editor.processEvent(event);
             if (event.type == sf::Event::Closed) {
                 window.close();
             }
+            redraw = true;
+        }
+        if (core->update()) {
+            redraw = true;
+        }
+
+        if (redraw) {
+            pendingFrames = settleFrames;
+        } else if (pendingFrames == 0) {
+            // Idle: sleep until the core publishes a state or it is time to poll the window again
+            if (core->waitUpdate(idleTimeout)) {
+                pendingFrames = settleFrames;
+            }
+            continue;
         }
+        --pendingFrames;
+
+        const auto frameStart = rb::detail::Metrics::now();
+
         editor.update(timer.restart());
-        core->update();
 
         window.clear();
 
         editor.render();
 
+        // Display blocks on vsync, so it is kept out of the frame time
+        const auto displayStart = rb::detail::Metrics::now();
+        rb::detail::Metrics::instance().frameTime.record(displayStart - frameStart);
+
         window.display();
+
+        rb::detail::Metrics::instance().displayTime.record(rb::detail::Metrics::now() - displayStart);
     }
     core->exit();
     editor.exit();
+    config.stop();
+    logger.flush();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include "metrics.h"
+#include <chrono>
+
+namespace rb {
+    namespace detail {
+
+        const int Histogram::SUB_BUCKET_BITS;
+        const std::size_t Histogram::LINEAR;
+        const int Histogram::MAX_EXPONENT;
+        const std::size_t Histogram::BUCKETS;
+
+        std::size_t Histogram::bucketOf(std::uint64_t value) {
+            if (value < LINEAR) return static_cast<std::size_t>(value);
+            const int exponent = 63 - __builtin_clzll(value);
+            if (exponent >= MAX_EXPONENT) return BUCKETS - 1;
+            const std::size_t sub = (value >> (exponent - SUB_BUCKET_BITS)) & ((std::size_t(1) << SUB_BUCKET_BITS) - 1);
+            return LINEAR + (exponent - SUB_BUCKET_BITS - 1) * (std::size_t(1) << SUB_BUCKET_BITS) + sub;
+        }
+
+        std::uint64_t Histogram::highestOf(std::size_t bucket) {
+            if (bucket < LINEAR) return bucket;
+            const std::size_t octave = (bucket - LINEAR) >> SUB_BUCKET_BITS;
+            const std::size_t sub = (bucket - LINEAR) & ((std::size_t(1) << SUB_BUCKET_BITS) - 1);
+            const int shift = static_cast<int>(octave) + 1;
+            return (((std::uint64_t(1) << SUB_BUCKET_BITS) + sub + 1) << shift) - 1;
+        }
+
+        void Histogram::record(std::uint64_t value) {
+            this->_counts[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+            std::uint64_t max = this->_max.load(std::memory_order_relaxed);
+            while (value > max && !this->_max.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+            }
+        }
+
+        HistogramSummary Histogram::summary() const {
+            std::array<std::uint64_t, BUCKETS> counts;
+            HistogramSummary summary;
+            for (std::size_t i = 0; i < BUCKETS; ++i) {
+                counts[i] = this->_counts[i].load(std::memory_order_relaxed);
+                summary.count += counts[i];
+            }
+            if (summary.count == 0) return summary;
+
+            summary.max = this->_max.load(std::memory_order_relaxed);
+            const std::uint64_t p50 = (summary.count + 1) / 2;
+            const std::uint64_t p99 = summary.count - summary.count / 100;
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < BUCKETS; ++i) {
+                if (counts[i] == 0) continue;
+                const std::uint64_t before = seen;
+                seen += counts[i];
+                if (before < p50 && seen >= p50) summary.p50 = highestOf(i);
+                if (before < p99 && seen >= p99) {
+                    summary.p99 = highestOf(i);
+                    break;
+                }
+            }
+            // The bucket bound may be above the largest value actually recorded
+            if (summary.p50 > summary.max) summary.p50 = summary.max;
+            if (summary.p99 > summary.max) summary.p99 = summary.max;
+            return summary;
+        }
+
+        void Histogram::reset() {
+            for (auto &count : this->_counts) {
+                count.store(0, std::memory_order_relaxed);
+            }
+            this->_max.store(0, std::memory_order_relaxed);
+        }
+
+        Metrics &Metrics::instance() {
+            static Metrics metrics;
+            return metrics;
+        }
+
+        std::uint64_t Metrics::now() {
+            return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+    }
+}
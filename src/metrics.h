@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace rb {
+    namespace detail {
+
+        struct HistogramSummary {
+            std::uint64_t count = 0;
+            std::uint64_t p50 = 0;
+            std::uint64_t p99 = 0;
+            std::uint64_t max = 0;
+        };
+
+        /*
+         * Log-linear histogram in the style of HdrHistogram. Values below 64 have a bucket each,
+         * above that every power of two is split into 32 buckets, so a percentile is off by at
+         * most 1/32 of its value. Recording is a few relaxed atomic adds and safe from any thread.
+         */
+        class Histogram {
+        public:
+            static const int SUB_BUCKET_BITS = 5;
+            static const std::size_t LINEAR = std::size_t(1) << (SUB_BUCKET_BITS + 1);
+            // Values from 2^MAX_EXPONENT up land in the last bucket
+            static const int MAX_EXPONENT = 42;
+            static const std::size_t BUCKETS =
+                    LINEAR + (MAX_EXPONENT - SUB_BUCKET_BITS - 1) * (std::size_t(1) << SUB_BUCKET_BITS);
+
+            void record(std::uint64_t value);
+
+            // Percentiles are the highest value of their bucket
+            HistogramSummary summary() const;
+
+            // Not atomic with concurrent record calls, a value recorded meanwhile may be kept
+            void reset();
+
+        private:
+            static std::size_t bucketOf(std::uint64_t value);
+
+            static std::uint64_t highestOf(std::size_t bucket);
+
+            std::array<std::atomic<std::uint64_t>, BUCKETS> _counts{};
+            std::atomic<std::uint64_t> _max{0};
+        };
+
+        /*
+         * Latencies shown in the metrics window, all in nanoseconds
+         */
+        class Metrics {
+        public:
+            static Metrics &instance();
+
+            static std::uint64_t now();
+
+            // Send of a command to its acknowledgement
+            Histogram commandRtt;
+            // Event queued by notifyEvent until the core runs it
+            Histogram queueWait;
+            // One pass of Core::input over the queued events
+            Histogram coreInput;
+            // Update and render of one editor frame, without display
+            Histogram frameTime;
+            // Display of a frame, includes the wait for vsync
+            Histogram displayTime;
+
+        private:
+            Metrics() = default;
+
+            Metrics(const Metrics &) = delete;
+
+            Metrics &operator=(const Metrics &) = delete;
+        };
+    }
+}
@@ -0,0 +1,79 @@
+#include "path_compiler.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace rb {
+
+    namespace {
+        Direction clockwise(Direction direction) {
+            switch (direction) {
+                case Direction::Up:
+                    return Direction::Right;
+                case Direction::Right:
+                    return Direction::Down;
+                case Direction::Down:
+                    return Direction::Left;
+                default:
+                    return Direction::Up;
+            }
+        }
+    }
+
+    const int PathCompiler::MAX_LENGTH;
+
+    PathCompiler::PathCompiler(int tileSize) : _tileSize(tileSize) {}
+
+    std::vector<Command> PathCompiler::compile(const std::vector<int> &xs, const std::vector<int> &ys) const {
+        std::vector<Command> commands;
+        const std::size_t count = std::min(xs.size(), ys.size());
+        commands.reserve(count * 2);
+
+        bool started = false;
+        Direction heading = Direction::Up;
+        // Straight distance which was not emitted yet
+        int length = 0;
+
+        auto step = [&](Direction next, int distance) {
+            if (distance == 0) return;
+            if (started && next != heading) {
+                this->move(commands, heading, length);
+                length = 0;
+                this->turn(commands, heading, next);
+            }
+            heading = next;
+            started = true;
+            length += distance;
+        };
+
+        for (std::size_t i = 1; i < count; ++i) {
+            int dx = xs[i] - xs[i - 1];
+            int dy = ys[i] - ys[i - 1];
+            step(dy < 0 ? Direction::Up : Direction::Down, std::abs(dy));
+            step(dx < 0 ? Direction::Left : Direction::Right, std::abs(dx));
+        }
+        if (started) {
+            this->move(commands, heading, length);
+        }
+        return commands;
+    }
+
+    void PathCompiler::turn(std::vector<Command> &commands, Direction from, Direction to) const {
+        if (to == clockwise(from)) {
+            commands.push_back(Command{this->_tileSize, 0, Direction::Right, to});
+        } else if (from == clockwise(to)) {
+            commands.push_back(Command{this->_tileSize, 0, Direction::Left, to});
+        } else {
+            // Reversal
+            commands.push_back(Command{this->_tileSize, 0, Direction::Right, clockwise(from)});
+            commands.push_back(Command{this->_tileSize, 0, Direction::Right, to});
+        }
+    }
+
+    void PathCompiler::move(std::vector<Command> &commands, Direction heading, int length) const {
+        while (length > 0) {
+            int part = std::min(length, MAX_LENGTH);
+            commands.push_back(Command{this->_tileSize, part, Direction::Up, heading});
+            length -= part;
+        }
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+#include "data.h"
+
+namespace rb {
+
+    /*
+     * Compiles a route of grid waypoints into robot commands.
+     * Straight moves in the same direction are merged into one command, turns are emitted only
+     * where the heading changes, a reversal becomes two turns. Diagonal segments are driven as
+     * a vertical then a horizontal leg. The robot starts facing along the first segment.
+     */
+    class PathCompiler {
+    public:
+        // Longest move the protocol can carry in one command
+        static const int MAX_LENGTH = 255;
+
+        explicit PathCompiler(int tileSize);
+
+        // Coordinates of the waypoints in tiles, both vectors have one element per waypoint
+        std::vector<Command> compile(const std::vector<int> &xs, const std::vector<int> &ys) const;
+
+    private:
+        void turn(std::vector<Command> &commands, Direction from, Direction to) const;
+
+        void move(std::vector<Command> &commands, Direction heading, int length) const;
+
+        int _tileSize;
+    };
+}
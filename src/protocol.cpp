@@ -0,0 +1,61 @@
+#include "protocol.h"
+#include <array>
+
+namespace rb {
+
+    namespace {
+        const std::array<uint16_t, 256> &crcTable() {
+            static const std::array<uint16_t, 256> table = [] {
+                std::array<uint16_t, 256> t;
+                for (unsigned int i = 0; i < 256; ++i) {
+                    uint16_t crc = static_cast<uint16_t>(i << 8);
+                    for (int bit = 0; bit < 8; ++bit) {
+                        crc = static_cast<uint16_t>((crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1);
+                    }
+                    t[i] = crc;
+                }
+                return t;
+            }();
+            return table;
+        }
+    }
+
+    uint16_t crc16(const uint8_t *data, std::size_t size) {
+        const auto &table = crcTable();
+        uint16_t crc = 0xFFFF;
+        for (std::size_t i = 0; i < size; ++i) {
+            crc = static_cast<uint16_t>((crc << 8) ^ table[((crc >> 8) ^ data[i]) & 0xFF]);
+        }
+        return crc;
+    }
+
+    void encodeFrame(std::vector<uint8_t> &out, FrameType type, uint8_t seq, const uint8_t *payload, std::size_t size) {
+        const std::size_t begin = out.size();
+        out.reserve(begin + protocol::HEADER_SIZE + size + protocol::TRAILER_SIZE);
+        out.push_back(protocol::MAGIC_0);
+        out.push_back(protocol::MAGIC_1);
+        out.push_back(static_cast<uint8_t>(size & 0xFF));
+        out.push_back(static_cast<uint8_t>((size >> 8) & 0xFF));
+        out.push_back(seq);
+        out.push_back(static_cast<uint8_t>(type));
+        out.insert(out.end(), payload, payload + size);
+
+        const uint16_t crc = crc16(out.data() + begin + 2, protocol::HEADER_SIZE - 2 + size);
+        out.push_back(static_cast<uint8_t>(crc & 0xFF));
+        out.push_back(static_cast<uint8_t>(crc >> 8));
+    }
+
+    std::vector<uint8_t> encodeFrame(FrameType type, uint8_t seq, std::initializer_list<uint8_t> payload) {
+        std::vector<uint8_t> out;
+        encodeFrame(out, type, seq, payload.begin(), payload.size());
+        return out;
+    }
+
+    std::size_t FrameParser::getDropped() const {
+        return this->_dropped;
+    }
+
+    std::size_t FrameParser::getCorrupted() const {
+        return this->_corrupted;
+    }
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+namespace rb {
+
+    /*
+     * Frame layout, multi-byte fields are little endian:
+     *   'R' 'B' | payload length (2) | seq | type | payload | CRC-16/CCITT of length..payload (2)
+     */
+    namespace protocol {
+        const uint8_t MAGIC_0 = 'R';
+        const uint8_t MAGIC_1 = 'B';
+        const std::size_t HEADER_SIZE = 6;
+        const std::size_t TRAILER_SIZE = 2;
+        const std::size_t MAX_PAYLOAD = 1024;
+    }
+
+    enum class FrameType : uint8_t {
+        // Payload {direction, length, size}
+        Command = 1,
+        // Acknowledges every command up to seq
+        Ack = 2,
+        // The command with seq was rejected
+        Nak = 3,
+        Stop = 4,
+        Telemetry = 5
+    };
+
+    // Non-owning view of received bytes, valid only inside the callback it was passed to
+    struct BufferView {
+        const uint8_t *data = nullptr;
+        std::size_t size = 0;
+
+        bool empty() const {
+            return size == 0;
+        }
+
+        uint8_t operator[](std::size_t i) const {
+            return data[i];
+        }
+    };
+
+    // Points into the buffer the frame was parsed from, valid only inside the callback
+    struct FrameView {
+        FrameType type;
+        uint8_t seq;
+        const uint8_t *payload;
+        std::size_t size;
+    };
+
+    uint16_t crc16(const uint8_t *data, std::size_t size);
+
+    // Appends the encoded frame to out
+    void encodeFrame(std::vector<uint8_t> &out, FrameType type, uint8_t seq, const uint8_t *payload, std::size_t size);
+
+    std::vector<uint8_t> encodeFrame(FrameType type, uint8_t seq, std::initializer_list<uint8_t> payload = {});
+
+    /*
+     * Finds frames in a byte stream without copying them. Garbage and corrupted frames are skipped
+     * byte by byte until the next valid header.
+     */
+    class FrameParser {
+    public:
+        // Calls onFrame for every complete frame of the data and returns the number of bytes consumed.
+        // The bytes which were not consumed are the beginning of a frame and must be passed again
+        // with the data which follows them.
+        template<class F>
+        std::size_t parse(const uint8_t *data, std::size_t size, F onFrame) {
+            using namespace protocol;
+            std::size_t position = 0;
+            while (size - position >= HEADER_SIZE + TRAILER_SIZE) {
+                const uint8_t *frame = data + position;
+                if (frame[0] != MAGIC_0 || frame[1] != MAGIC_1) {
+                    ++position;
+                    ++this->_dropped;
+                    continue;
+                }
+                const std::size_t length = frame[2] | (static_cast<std::size_t>(frame[3]) << 8);
+                if (length > MAX_PAYLOAD) {
+                    ++position;
+                    ++this->_dropped;
+                    continue;
+                }
+                if (size - position < HEADER_SIZE + length + TRAILER_SIZE) break;
+
+                const uint8_t *trailer = frame + HEADER_SIZE + length;
+                const uint16_t crc = static_cast<uint16_t>(trailer[0] | (trailer[1] << 8));
+                if (crc != crc16(frame + 2, HEADER_SIZE - 2 + length)) {
+                    ++position;
+                    ++this->_corrupted;
+                    continue;
+                }
+                onFrame(FrameView{static_cast<FrameType>(frame[5]), frame[4], frame + HEADER_SIZE, length});
+                position += HEADER_SIZE + length + TRAILER_SIZE;
+            }
+            return position;
+        }
+
+        // Bytes skipped while looking for a header
+        std::size_t getDropped() const;
+
+        // Frames rejected because of a wrong CRC
+        std::size_t getCorrupted() const;
+
+    private:
+        std::size_t _dropped = 0;
+        std::size_t _corrupted = 0;
+    };
+}
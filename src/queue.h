@@ -2,8 +2,14 @@
 
 
 #include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
 #include <mutex>
 #include <condition_variable>
+#include <system_error>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 namespace rb {
 
@@ -79,4 +85,119 @@ namespace rb {
         std::array<TData, BufferSize> buffer_;
     };
 
-}
\ No newline at end of file
+    /*
+     * Bounded lock-free queue for many producers and one consumer. Every slot carries a sequence
+     * number which tells whose turn it is, so producers only race for the tail index and the
+     * consumer never touches a shared index at all. push never blocks and fails when the queue
+     * is full. The consumer sleeps on an eventfd, which producers only write to when the
+     * consumer is actually asleep, so a push is a syscall only after the queue ran empty.
+     */
+    template <class TData, std::size_t Capacity>
+    class MpscQueue {
+        static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    public:
+        MpscQueue() : eventFd_(::eventfd(0, EFD_CLOEXEC)) {
+            if (eventFd_ < 0) throw std::system_error(errno, std::generic_category(), "eventfd");
+            for (std::size_t i = 0; i < Capacity; ++i) {
+                slots_[i].seq.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        ~MpscQueue() {
+            ::close(eventFd_);
+        }
+
+        MpscQueue(const MpscQueue &) = delete;
+
+        MpscQueue &operator=(const MpscQueue &) = delete;
+
+        // Any thread. Returns false if the queue is full.
+        bool push(TData item) {
+            std::size_t position = tail_.load(std::memory_order_relaxed);
+            Slot *slot;
+            while (true) {
+                slot = &slots_[position & (Capacity - 1)];
+                const std::size_t seq = slot->seq.load(std::memory_order_acquire);
+                const auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(position);
+                if (diff == 0) {
+                    if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+                } else if (diff < 0) {
+                    // The consumer has not freed the slot of the previous round yet
+                    return false;
+                } else {
+                    position = tail_.load(std::memory_order_relaxed);
+                }
+            }
+
+            slot->data = std::move(item);
+            slot->seq.store(position + 1, std::memory_order_release);
+
+            // Pairs with the fence in wait, either the consumer sees the item or we see it sleeping
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (sleeping_.load(std::memory_order_relaxed) && sleeping_.exchange(false)) {
+                const std::uint64_t one = 1;
+                while (::write(eventFd_, &one, sizeof(one)) < 0 && errno == EINTR) {
+                }
+            }
+            return true;
+        }
+
+        // Consumer only. Returns false if the queue is empty.
+        bool tryPop(TData &item) {
+            Slot &slot = slots_[head_ & (Capacity - 1)];
+            if (slot.seq.load(std::memory_order_acquire) != head_ + 1) return false;
+            item = std::move(slot.data);
+            // Release what the item holds now rather than when the slot is reused
+            slot.data = TData();
+            slot.seq.store(head_ + Capacity, std::memory_order_release);
+            ++head_;
+            return true;
+        }
+
+        // Consumer only. Blocks until the queue is not empty.
+        void wait() {
+            while (!ready()) {
+                sleeping_.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (ready()) {
+                    sleeping_.store(false, std::memory_order_relaxed);
+                    return;
+                }
+                // A wakeup left over from an earlier round only costs one more turn of the loop
+                std::uint64_t value;
+                while (::read(eventFd_, &value, sizeof(value)) < 0 && errno == EINTR) {
+                }
+            }
+        }
+
+        // Consumer only
+        bool empty() const {
+            return !ready();
+        }
+
+    private:
+        struct Slot {
+            std::atomic<std::size_t> seq;
+            TData data;
+        };
+
+        bool ready() const {
+            return slots_[head_ & (Capacity - 1)].seq.load(std::memory_order_acquire) == head_ + 1;
+        }
+
+        // Producers and the consumer write different cache lines. Padded rather than aligned,
+        // the queue lives in heap objects and C++14 new ignores extended alignment.
+        static const std::size_t CACHE_LINE = 64;
+
+        std::atomic<std::size_t> tail_{0};
+        char tailPadding_[CACHE_LINE];
+        std::size_t head_ = 0;
+        std::atomic<bool> sleeping_{false};
+        int eventFd_;
+        char headPadding_[CACHE_LINE];
+
+        std::array<Slot, Capacity> slots_;
+    };
+
+}
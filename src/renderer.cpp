@@ -0,0 +1,277 @@
+#include "renderer.h"
+#include <array>
+#include <cmath>
+
+namespace rb {
+    namespace detail {
+
+        namespace {
+            const std::size_t CIRCLE_POINT_COUNT = 16;
+
+            // Minimal distance in pixels between two drawn grid lines
+            const float GRID_MIN_SPACING = 4.0f;
+
+            const std::array<sf::Vector2f, CIRCLE_POINT_COUNT + 1> &unitCircle() {
+                static const std::array<sf::Vector2f, CIRCLE_POINT_COUNT + 1> circle = [] {
+                    std::array<sf::Vector2f, CIRCLE_POINT_COUNT + 1> c;
+                    for (std::size_t i = 0; i <= CIRCLE_POINT_COUNT; ++i) {
+                        float angle = static_cast<float>(i) * 2.0f * 3.141592654f / CIRCLE_POINT_COUNT;
+                        c[i] = sf::Vector2f(std::cos(angle), std::sin(angle));
+                    }
+                    return c;
+                }();
+                return circle;
+            }
+
+            void drawLayer(Graphics &graphics, const sf::VertexArray &layer) {
+                if (layer.getVertexCount() > 0) {
+                    graphics.draw(&layer[0], static_cast<unsigned int>(layer.getVertexCount()),
+                                  layer.getPrimitiveType());
+                }
+            }
+        }
+
+        ShapeBatch::ShapeBatch() :
+                _points(sf::Triangles),
+                _segments(sf::Quads),
+                _selection(sf::Triangles),
+                _cellSize(1.0f, 1.0f),
+                _culling(false) {}
+
+        void ShapeBatch::clear() {
+            this->_points.clear();
+            this->_segments.clear();
+            this->_selection.clear();
+            this->_stats = RenderStats();
+        }
+
+        void ShapeBatch::setViewport(const sf::FloatRect &viewport) {
+            this->_viewport = viewport;
+            this->_culling = true;
+        }
+
+        bool ShapeBatch::isVisible(const sf::FloatRect &bounds) const {
+            return !this->_culling ||
+                   (bounds.left <= this->_viewport.left + this->_viewport.width &&
+                    bounds.left + bounds.width >= this->_viewport.left &&
+                    bounds.top <= this->_viewport.top + this->_viewport.height &&
+                    bounds.top + bounds.height >= this->_viewport.top);
+        }
+
+        bool ShapeBatch::isVisible(const sf::IntRect &tiles) const {
+            const float margin = WAYPOINT_RADIUS + WAYPOINT_SELECTED_OUTLINE;
+            return this->isVisible(sf::FloatRect(tiles.left * this->_cellSize.x - margin,
+                                                 tiles.top * this->_cellSize.y - margin,
+                                                 tiles.width * this->_cellSize.x + margin * 2,
+                                                 tiles.height * this->_cellSize.y + margin * 2));
+        }
+
+        void ShapeBatch::setCellSize(sf::Vector2f cellSize) {
+            this->_cellSize = cellSize;
+        }
+
+        sf::Vector2f ShapeBatch::toWorld(sf::Vector2i tile) const {
+            return sf::Vector2f(tile.x * this->_cellSize.x, tile.y * this->_cellSize.y);
+        }
+
+        void ShapeBatch::cull(std::size_t primitives) {
+            this->_stats.culled += primitives;
+        }
+
+        const RenderStats &ShapeBatch::getStats() const {
+            return this->_stats;
+        }
+
+        void ShapeBatch::addPoint(sf::Vector2f center, float radius, sf::Color fill, sf::Color outline,
+                                  float outlineThickness, bool selected) {
+            float extent = radius + std::max(outlineThickness, 0.0f);
+            if (!this->isVisible(sf::FloatRect(center.x - extent, center.y - extent, extent * 2, extent * 2))) {
+                this->cull(1);
+                return;
+            }
+            ++this->_stats.drawn;
+
+            const auto &circle = unitCircle();
+            for (std::size_t i = 0; i < CIRCLE_POINT_COUNT; ++i) {
+                this->_points.append(sf::Vertex(center, fill));
+                this->_points.append(sf::Vertex(center + circle[i] * radius, fill));
+                this->_points.append(sf::Vertex(center + circle[i + 1] * radius, fill));
+            }
+            if (outlineThickness > 0) {
+                // Selected outlines go to their own layer so they are drawn over everything else
+                this->addRing(selected ? this->_selection : this->_points, center, radius, radius + outlineThickness,
+                              outline);
+            }
+        }
+
+        void ShapeBatch::addSegment(sf::Vector2f from, sf::Vector2f to, float thickness, sf::Color color) {
+            sf::FloatRect bounds(std::min(from.x, to.x) - thickness, std::min(from.y, to.y) - thickness,
+                                 std::abs(to.x - from.x) + thickness * 2, std::abs(to.y - from.y) + thickness * 2);
+            if (!this->isVisible(bounds)) {
+                this->cull(1);
+                return;
+            }
+            ++this->_stats.drawn;
+
+            sf::Vector2f direction = to - from;
+            float length = std::sqrt(direction.x * direction.x + direction.y * direction.y);
+            if (length <= 0) return;
+
+            sf::Vector2f unitDirection = direction / length;
+            sf::Vector2f unitPerpendicular(-unitDirection.y, unitDirection.x);
+
+            sf::Vector2f offset = (thickness / 2.0f) * unitPerpendicular;
+
+            this->_segments.append(sf::Vertex(from + offset, color));
+            this->_segments.append(sf::Vertex(to + offset, color));
+            this->_segments.append(sf::Vertex(to - offset, color));
+            this->_segments.append(sf::Vertex(from - offset, color));
+        }
+
+        void ShapeBatch::addWaypoint(sf::Vector2i tile, sf::Color color, bool selected) {
+            sf::Color fill(color.r, color.g, color.b, 80);
+            if (selected) {
+                auto brighten = [](sf::Uint8 c) { return static_cast<sf::Uint8>(std::min(155, c + 16)); };
+                fill = sf::Color(brighten(fill.r), brighten(fill.g), brighten(fill.b), brighten(fill.a));
+            }
+            this->addPoint(this->toWorld(tile), WAYPOINT_RADIUS, fill, sf::Color(color.r, color.g, color.b, 160),
+                           selected ? WAYPOINT_SELECTED_OUTLINE : WAYPOINT_OUTLINE, selected);
+        }
+
+        void ShapeBatch::addRing(sf::VertexArray &layer, sf::Vector2f center, float innerRadius, float outerRadius,
+                                 sf::Color color) {
+            const auto &circle = unitCircle();
+            for (std::size_t i = 0; i < CIRCLE_POINT_COUNT; ++i) {
+                sf::Vector2f inner1 = center + circle[i] * innerRadius;
+                sf::Vector2f inner2 = center + circle[i + 1] * innerRadius;
+                sf::Vector2f outer1 = center + circle[i] * outerRadius;
+                sf::Vector2f outer2 = center + circle[i + 1] * outerRadius;
+
+                layer.append(sf::Vertex(inner1, color));
+                layer.append(sf::Vertex(outer1, color));
+                layer.append(sf::Vertex(outer2, color));
+                layer.append(sf::Vertex(inner1, color));
+                layer.append(sf::Vertex(outer2, color));
+                layer.append(sf::Vertex(inner2, color));
+            }
+        }
+
+        void ShapeBatch::draw(Graphics &graphics) const {
+            drawLayer(graphics, this->_points);
+            drawLayer(graphics, this->_segments);
+            drawLayer(graphics, this->_selection);
+        }
+
+        bool ShapeBatch::empty() const {
+            return this->_points.getVertexCount() == 0 && this->_segments.getVertexCount() == 0 &&
+                   this->_selection.getVertexCount() == 0;
+        }
+
+        void ShapeRenderer::draw(Level &level, Graphics &graphics) {
+            const sf::View view = graphics.getView();
+            const sf::FloatRect viewport(view.getCenter() - view.getSize() / 2.0f, view.getSize());
+            const sf::Vector2f cellSize = level.getCellSize();
+
+            if (!this->_valid || this->_revision != level.getRevision() || cellSize != this->_cellSize ||
+                viewport.left != this->_viewport.left || viewport.top != this->_viewport.top ||
+                viewport.width != this->_viewport.width || viewport.height != this->_viewport.height) {
+                this->_batch.clear();
+                this->_batch.setViewport(viewport);
+                this->_batch.setCellSize(cellSize);
+                for (const auto &entry : level.getShapes()) {
+                    entry.value->draw(this->_batch);
+                }
+                this->_viewport = viewport;
+                this->_cellSize = cellSize;
+                this->_revision = level.getRevision();
+                this->_valid = true;
+            }
+            this->_batch.draw(graphics);
+        }
+
+        void ShapeRenderer::invalidate() {
+            this->_valid = false;
+        }
+
+        const RenderStats &ShapeRenderer::getStats() const {
+            return this->_batch.getStats();
+        }
+
+        GridRenderer::GridRenderer() :
+                _lines(sf::Lines),
+                _step(0) {}
+
+        void GridRenderer::draw(const Level &level, Graphics &graphics) {
+            const sf::Vector2i size = level.getSize();
+            if (size.x <= 0 || size.y <= 0) return;
+
+            const sf::Vector2f tileScale = utils::getTileScale();
+            const sf::Vector2f cellSize(level.getTileSize().x * tileScale.x, level.getTileSize().y * tileScale.y);
+            if (cellSize.x <= 0 || cellSize.y <= 0) return;
+
+            const sf::View view = graphics.getView();
+            const sf::Vector2f topLeft = view.getCenter() - view.getSize() / 2.0f;
+            const sf::Vector2f bottomRight = view.getCenter() + view.getSize() / 2.0f;
+
+            // Skip lines that would be closer than a few pixels on screen
+            const float pixelsPerUnit = graphics.getZoomPercentage() / 100.0f;
+            const float spacing = std::min(cellSize.x, cellSize.y) * pixelsPerUnit;
+            int step = 1;
+            while (spacing * step < GRID_MIN_SPACING) step *= 2;
+
+            auto firstLine = [step](float coord, float cell, int count) {
+                int i = static_cast<int>(std::floor(coord / cell));
+                return std::max(0, std::min(count, i - i % step));
+            };
+            auto lastLine = [](float coord, float cell, int count) {
+                return std::max(0, std::min(count, static_cast<int>(std::ceil(coord / cell))));
+            };
+
+            sf::IntRect range;
+            range.left = firstLine(topLeft.x, cellSize.x, size.x);
+            range.top = firstLine(topLeft.y, cellSize.y, size.y);
+            range.width = lastLine(bottomRight.x, cellSize.x, size.x) - range.left;
+            range.height = lastLine(bottomRight.y, cellSize.y, size.y) - range.top;
+
+            if (range.width < 0 || range.height < 0) return;
+
+            if (range.left != this->_range.left || range.top != this->_range.top ||
+                range.width != this->_range.width || range.height != this->_range.height ||
+                step != this->_step || cellSize != this->_cellSize) {
+
+                this->_lines.clear();
+
+                const float left = range.left * cellSize.x;
+                const float right = (range.left + range.width) * cellSize.x;
+                const float top = range.top * cellSize.y;
+                const float bottom = (range.top + range.height) * cellSize.y;
+
+                //Horizontal lines, the map border is always drawn
+                for (int i = range.top; i <= range.top + range.height; i += step) {
+                    this->_lines.append(sf::Vertex(sf::Vector2f(left, i * cellSize.y)));
+                    this->_lines.append(sf::Vertex(sf::Vector2f(right, i * cellSize.y)));
+                }
+                if (range.top + range.height == size.y && range.height % step != 0) {
+                    this->_lines.append(sf::Vertex(sf::Vector2f(left, bottom)));
+                    this->_lines.append(sf::Vertex(sf::Vector2f(right, bottom)));
+                }
+
+                //Vertical lines
+                for (int i = range.left; i <= range.left + range.width; i += step) {
+                    this->_lines.append(sf::Vertex(sf::Vector2f(i * cellSize.x, top)));
+                    this->_lines.append(sf::Vertex(sf::Vector2f(i * cellSize.x, bottom)));
+                }
+                if (range.left + range.width == size.x && range.width % step != 0) {
+                    this->_lines.append(sf::Vertex(sf::Vector2f(right, top)));
+                    this->_lines.append(sf::Vertex(sf::Vector2f(right, bottom)));
+                }
+
+                this->_range = range;
+                this->_step = step;
+                this->_cellSize = cellSize;
+            }
+
+            drawLayer(graphics, this->_lines);
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+#include "detail.h"
+
+namespace rb {
+    namespace detail {
+
+        /*
+         * Number of primitives (points and segments) which were submitted or skipped by culling
+         */
+        struct RenderStats {
+            std::size_t drawn = 0;
+            std::size_t culled = 0;
+        };
+
+        /*
+         * Geometry of a set of shapes packed into one vertex array per layer,
+         * so the whole set is submitted in a handful of draw calls
+         */
+        class ShapeBatch {
+        public:
+            ShapeBatch();
+
+            void clear();
+
+            // Geometry outside the viewport is skipped. Culling is off until a viewport is set.
+            void setViewport(const sf::FloatRect &viewport);
+
+            bool isVisible(const sf::FloatRect &bounds) const;
+
+            // Visibility of waypoints on a range of tiles, including their outlines
+            bool isVisible(const sf::IntRect &tiles) const;
+
+            // Size of a tile in world units, used to place waypoints
+            void setCellSize(sf::Vector2f cellSize);
+
+            sf::Vector2f toWorld(sf::Vector2i tile) const;
+
+            // Accounts primitives which were skipped without being added
+            void cull(std::size_t primitives);
+
+            const RenderStats &getStats() const;
+
+            void addPoint(sf::Vector2f center, float radius, sf::Color fill, sf::Color outline,
+                          float outlineThickness, bool selected);
+
+            void addSegment(sf::Vector2f from, sf::Vector2f to, float thickness, sf::Color color);
+
+            void addWaypoint(sf::Vector2i tile, sf::Color color, bool selected);
+
+            void draw(Graphics &graphics) const;
+
+            bool empty() const;
+
+        private:
+            void addRing(sf::VertexArray &layer, sf::Vector2f center, float innerRadius, float outerRadius,
+                         sf::Color color);
+
+            sf::VertexArray _points;
+            sf::VertexArray _segments;
+            sf::VertexArray _selection;
+            sf::FloatRect _viewport;
+            sf::Vector2f _cellSize;
+            bool _culling;
+            RenderStats _stats;
+        };
+
+        /*
+         * Keeps a batch of the visible level shapes and rebuilds it only when the level or the view changes
+         */
+        class ShapeRenderer {
+        public:
+            void draw(Level &level, Graphics &graphics);
+
+            void invalidate();
+
+            const RenderStats &getStats() const;
+
+        private:
+            ShapeBatch _batch;
+            sf::FloatRect _viewport;
+            sf::Vector2f _cellSize;
+            unsigned long _revision = 0;
+            bool _valid = false;
+        };
+
+        /*
+         * Emits only the grid lines inside the current view. When zoomed out far enough
+         * that neighbouring lines would merge on screen, only every n-th line is drawn.
+         */
+        class GridRenderer {
+        public:
+            GridRenderer();
+
+            void draw(const Level &level, Graphics &graphics);
+
+        private:
+            sf::VertexArray _lines;
+            sf::IntRect _range;
+            int _step;
+            sf::Vector2f _cellSize;
+        };
+    }
+}
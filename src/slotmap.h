@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace rb {
+
+    /*
+     * Handle of an element of a SlotMap. The generation is bumped every time the slot is freed,
+     * so a handle of a removed element never resolves again, even after its slot was reused.
+     */
+    struct SlotHandle {
+        static const std::uint32_t INVALID_INDEX = std::numeric_limits<std::uint32_t>::max();
+
+        std::uint32_t index = INVALID_INDEX;
+        std::uint32_t generation = 0;
+
+        bool valid() const {
+            return index != INVALID_INDEX;
+        }
+
+        bool operator==(const SlotHandle &other) const {
+            return index == other.index && generation == other.generation;
+        }
+
+        bool operator!=(const SlotHandle &other) const {
+            return !(*this == other);
+        }
+    };
+
+    /*
+     * Values are stored contiguously, removal moves the last value into the hole.
+     * Insert, lookup and remove by handle are O(1), iteration order is not stable across removals.
+     */
+    template <class TData>
+    class SlotMap {
+    public:
+        struct Entry {
+            SlotHandle handle;
+            const TData &value;
+        };
+
+        class const_iterator {
+        public:
+            const_iterator(const SlotMap *map, std::size_t position) : map_(map), position_(position) {}
+
+            Entry operator*() const {
+                return Entry{map_->handles_[position_], map_->values_[position_]};
+            }
+
+            const_iterator &operator++() {
+                ++position_;
+                return *this;
+            }
+
+            bool operator!=(const const_iterator &other) const {
+                return position_ != other.position_;
+            }
+
+        private:
+            const SlotMap *map_;
+            std::size_t position_;
+        };
+
+        SlotHandle insert(TData value) {
+            std::uint32_t index;
+            if (!freeSlots_.empty()) {
+                index = freeSlots_.back();
+                freeSlots_.pop_back();
+            } else {
+                index = static_cast<std::uint32_t>(slots_.size());
+                slots_.push_back(Slot{0, 0});
+            }
+            auto &slot = slots_[index];
+            slot.position = static_cast<std::uint32_t>(values_.size());
+
+            SlotHandle handle;
+            handle.index = index;
+            handle.generation = slot.generation;
+            values_.push_back(std::move(value));
+            handles_.push_back(handle);
+            return handle;
+        }
+
+        bool remove(SlotHandle handle) {
+            if (!contains(handle)) return false;
+
+            auto position = slots_[handle.index].position;
+            auto last = values_.size() - 1;
+            if (position != last) {
+                values_[position] = std::move(values_[last]);
+                handles_[position] = handles_[last];
+                slots_[handles_[position].index].position = position;
+            }
+            values_.pop_back();
+            handles_.pop_back();
+            release(handle.index);
+            return true;
+        }
+
+        bool contains(SlotHandle handle) const {
+            return handle.index < slots_.size() && slots_[handle.index].generation == handle.generation;
+        }
+
+        // Returns nullptr if the handle is stale
+        TData *get(SlotHandle handle) {
+            return contains(handle) ? &values_[slots_[handle.index].position] : nullptr;
+        }
+
+        const TData *get(SlotHandle handle) const {
+            return contains(handle) ? &values_[slots_[handle.index].position] : nullptr;
+        }
+
+        void clear() {
+            for (const auto &handle : handles_) {
+                release(handle.index);
+            }
+            values_.clear();
+            handles_.clear();
+        }
+
+        std::size_t size() const {
+            return values_.size();
+        }
+
+        bool empty() const {
+            return values_.empty();
+        }
+
+        const_iterator begin() const {
+            return const_iterator(this, 0);
+        }
+
+        const_iterator end() const {
+            return const_iterator(this, values_.size());
+        }
+
+    private:
+        struct Slot {
+            std::uint32_t position;
+            std::uint32_t generation;
+        };
+
+        void release(std::uint32_t index) {
+            ++slots_[index].generation;
+            freeSlots_.push_back(index);
+        }
+
+        std::vector<Slot> slots_;
+        std::vector<std::uint32_t> freeSlots_;
+        std::vector<TData> values_;
+        std::vector<SlotHandle> handles_;
+    };
+
+}
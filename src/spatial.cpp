@@ -0,0 +1,51 @@
+#include "spatial.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace rb {
+    namespace detail {
+
+        long long SpatialIndex::key(sf::Vector2i tile) {
+            return static_cast<long long>((static_cast<std::uint64_t>(static_cast<std::uint32_t>(tile.x)) << 32) |
+                                          static_cast<std::uint32_t>(tile.y));
+        }
+
+        sf::Vector2i SpatialIndex::tile(long long key) {
+            auto k = static_cast<std::uint64_t>(key);
+            return sf::Vector2i(static_cast<std::int32_t>(static_cast<std::uint32_t>(k >> 32)),
+                                static_cast<std::int32_t>(static_cast<std::uint32_t>(k & 0xffffffffu)));
+        }
+
+        void SpatialIndex::clear() {
+            this->_cells.clear();
+            this->_shapeKeys.clear();
+        }
+
+        void SpatialIndex::insert(SlotHandle shape, std::uint32_t waypoint, sf::Vector2i tile) {
+            auto k = key(tile);
+            this->_cells[k].push_back(Entry{shape, waypoint, tile});
+            this->_shapeKeys[shape.index].push_back(k);
+        }
+
+        void SpatialIndex::remove(SlotHandle shape) {
+            auto keys = this->_shapeKeys.find(shape.index);
+            if (keys == this->_shapeKeys.end()) return;
+
+            for (auto k : keys->second) {
+                auto cell = this->_cells.find(k);
+                if (cell == this->_cells.end()) continue;
+                auto &entries = cell->second;
+                entries.erase(std::remove_if(entries.begin(), entries.end(), [shape](const Entry &entry) {
+                    return entry.shape == shape;
+                }), entries.end());
+                if (entries.empty()) this->_cells.erase(cell);
+            }
+            this->_shapeKeys.erase(keys);
+        }
+
+        const std::vector<SpatialIndex::Entry> *SpatialIndex::find(sf::Vector2i tile) const {
+            auto cell = this->_cells.find(key(tile));
+            return cell == this->_cells.end() ? nullptr : &cell->second;
+        }
+    }
+}
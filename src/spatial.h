@@ -0,0 +1,66 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "slotmap.h"
+
+namespace rb {
+    namespace detail {
+
+        /*
+         * Uniform grid of the waypoints of a level keyed on tile coordinates
+         */
+        class SpatialIndex {
+        public:
+            struct Entry {
+                SlotHandle shape;
+                // Position of the waypoint in its shape
+                std::uint32_t waypoint;
+                sf::Vector2i tile;
+            };
+
+            static long long key(sf::Vector2i tile);
+
+            static sf::Vector2i tile(long long key);
+
+            void clear();
+
+            void insert(SlotHandle shape, std::uint32_t waypoint, sf::Vector2i tile);
+
+            void remove(SlotHandle shape);
+
+            // Returns nullptr if there is no waypoint on the tile
+            const std::vector<Entry> *find(sf::Vector2i tile) const;
+
+            // Calls f for every entry on the tiles of the range (bounds included)
+            template<class F>
+            void forEachInRange(sf::IntRect tiles, F f) const {
+                const auto area = static_cast<long long>(tiles.width + 1) * (tiles.height + 1);
+                if (area > static_cast<long long>(this->_cells.size())) {
+                    // Large ranges are cheaper to answer by walking the occupied cells
+                    for (const auto &cell : this->_cells) {
+                        auto t = tile(cell.first);
+                        if (t.x < tiles.left || t.x > tiles.left + tiles.width ||
+                            t.y < tiles.top || t.y > tiles.top + tiles.height) continue;
+                        for (const auto &entry : cell.second) f(entry);
+                    }
+                    return;
+                }
+                for (int y = tiles.top; y <= tiles.top + tiles.height; ++y) {
+                    for (int x = tiles.left; x <= tiles.left + tiles.width; ++x) {
+                        if (auto cell = this->find(sf::Vector2i(x, y))) {
+                            for (const auto &entry : *cell) f(entry);
+                        }
+                    }
+                }
+            }
+
+        private:
+            std::unordered_map<long long, std::vector<Entry>> _cells;
+            // Cells of every shape, keyed on the slot of its handle
+            std::unordered_map<std::uint32_t, std::vector<long long>> _shapeKeys;
+        };
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace rb {
+
+    /*
+     * Move-only void() callable stored inside the object, never on the heap. A callable larger
+     * than Capacity does not compile, so a task can not silently capture something big like a
+     * whole route: capture a pointer or a shared snapshot instead.
+     */
+    template<std::size_t Capacity>
+    class InlineTask {
+    public:
+        InlineTask() = default;
+
+        template<class F, class = typename std::enable_if<
+                !std::is_same<typename std::decay<F>::type, InlineTask>::value>::type>
+        InlineTask(F &&f) {
+            typedef typename std::decay<F>::type Fn;
+            static_assert(sizeof(Fn) <= Capacity, "Task captures too much, capture a pointer or a snapshot");
+            static_assert(alignof(Fn) <= alignof(std::max_align_t), "Task capture is over-aligned");
+            static_assert(std::is_nothrow_move_constructible<Fn>::value, "Task capture must be nothrow movable");
+
+            new(&this->_storage) Fn(std::forward<F>(f));
+            this->_ops = &Ops<Fn>::table;
+        }
+
+        InlineTask(InlineTask &&other) noexcept {
+            this->moveFrom(other);
+        }
+
+        InlineTask &operator=(InlineTask &&other) noexcept {
+            if (this != &other) {
+                this->reset();
+                this->moveFrom(other);
+            }
+            return *this;
+        }
+
+        InlineTask(const InlineTask &) = delete;
+
+        InlineTask &operator=(const InlineTask &) = delete;
+
+        ~InlineTask() {
+            this->reset();
+        }
+
+        explicit operator bool() const {
+            return this->_ops != nullptr;
+        }
+
+        void operator()() {
+            this->_ops->invoke(&this->_storage);
+        }
+
+        void reset() {
+            if (this->_ops == nullptr) return;
+            this->_ops->destroy(&this->_storage);
+            this->_ops = nullptr;
+        }
+
+    private:
+        struct Table {
+            void (*invoke)(void *);
+
+            // Move constructs into the destination and destroys the source
+            void (*move)(void *, void *);
+
+            void (*destroy)(void *);
+        };
+
+        template<class Fn>
+        struct Ops {
+            static void invoke(void *storage) {
+                (*static_cast<Fn *>(storage))();
+            }
+
+            static void move(void *destination, void *source) {
+                new(destination) Fn(std::move(*static_cast<Fn *>(source)));
+                static_cast<Fn *>(source)->~Fn();
+            }
+
+            static void destroy(void *storage) {
+                static_cast<Fn *>(storage)->~Fn();
+            }
+
+            static const Table table;
+        };
+
+        void moveFrom(InlineTask &other) {
+            if (other._ops == nullptr) return;
+            other._ops->move(&this->_storage, &other._storage);
+            this->_ops = other._ops;
+            other._ops = nullptr;
+        }
+
+        typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type _storage;
+        const Table *_ops = nullptr;
+    };
+
+    template<std::size_t Capacity>
+    template<class Fn>
+    const typename InlineTask<Capacity>::Table InlineTask<Capacity>::Ops<Fn>::table = {
+            &InlineTask<Capacity>::Ops<Fn>::invoke,
+            &InlineTask<Capacity>::Ops<Fn>::move,
+            &InlineTask<Capacity>::Ops<Fn>::destroy
+    };
+}
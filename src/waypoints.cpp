@@ -0,0 +1,118 @@
+#include "waypoints.h"
+
+namespace rb {
+    namespace detail {
+
+        NameTable &NameTable::instance() {
+            static NameTable table;
+            return table;
+        }
+
+        NameTable::NameTable() {
+            // Id 0 is the empty name, so a default constructed waypoint has a valid one
+            this->intern("");
+        }
+
+        std::uint32_t NameTable::intern(const std::string &name) {
+            auto it = this->_ids.find(name);
+            if (it != this->_ids.end()) return it->second;
+
+            auto id = static_cast<std::uint32_t>(this->_names.size());
+            this->_names.push_back(name);
+            this->_ids.emplace(name, id);
+            return id;
+        }
+
+        const std::string &NameTable::get(std::uint32_t id) const {
+            return id < this->_names.size() ? this->_names[id] : this->_names[0];
+        }
+
+        std::size_t WaypointStore::size() const {
+            return this->_x.size();
+        }
+
+        bool WaypointStore::empty() const {
+            return this->_x.empty();
+        }
+
+        void WaypointStore::clear() {
+            this->_x.clear();
+            this->_y.clear();
+            this->_color.clear();
+            this->_flags.clear();
+            this->_name.clear();
+        }
+
+        void WaypointStore::push(const Waypoint &waypoint) {
+            this->_x.push_back(waypoint.tile.x);
+            this->_y.push_back(waypoint.tile.y);
+            this->_color.push_back(waypoint.color);
+            this->_flags.push_back(waypoint.flags);
+            this->_name.push_back(waypoint.name);
+        }
+
+        void WaypointStore::erase(std::size_t index) {
+            this->_x.erase(this->_x.begin() + index);
+            this->_y.erase(this->_y.begin() + index);
+            this->_color.erase(this->_color.begin() + index);
+            this->_flags.erase(this->_flags.begin() + index);
+            this->_name.erase(this->_name.begin() + index);
+        }
+
+        Waypoint WaypointStore::get(std::size_t index) const {
+            Waypoint waypoint;
+            waypoint.tile = this->getTile(index);
+            waypoint.color = this->_color[index];
+            waypoint.flags = this->_flags[index];
+            waypoint.name = this->_name[index];
+            return waypoint;
+        }
+
+        sf::Vector2i WaypointStore::getTile(std::size_t index) const {
+            return sf::Vector2i(this->_x[index], this->_y[index]);
+        }
+
+        void WaypointStore::setTile(std::size_t index, sf::Vector2i tile) {
+            this->_x[index] = tile.x;
+            this->_y[index] = tile.y;
+        }
+
+        sf::Color WaypointStore::getColor(std::size_t index) const {
+            return this->_color[index];
+        }
+
+        void WaypointStore::setColor(std::size_t index, sf::Color color) {
+            this->_color[index] = color;
+        }
+
+        bool WaypointStore::hasFlag(std::size_t index, WaypointFlags flag) const {
+            return (this->_flags[index] & flag) != 0;
+        }
+
+        void WaypointStore::setFlag(std::size_t index, WaypointFlags flag, bool value) {
+            if (value) {
+                this->_flags[index] |= flag;
+            } else {
+                this->_flags[index] &= static_cast<std::uint8_t>(~flag);
+            }
+        }
+
+        void WaypointStore::setFlag(WaypointFlags flag, bool value) {
+            for (std::size_t i = 0; i < this->_flags.size(); ++i) {
+                this->setFlag(i, flag, value);
+            }
+        }
+
+        std::uint32_t WaypointStore::getName(std::size_t index) const {
+            return this->_name[index];
+        }
+
+        const std::vector<int> &WaypointStore::getX() const {
+            return this->_x;
+        }
+
+        const std::vector<int> &WaypointStore::getY() const {
+            return this->_y;
+        }
+    }
+}
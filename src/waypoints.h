@@ -0,0 +1,98 @@
+#pragma once
+
+#include <SFML/Graphics.hpp>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rb {
+    namespace detail {
+
+        // Look of a waypoint on screen, in world units
+        const float WAYPOINT_RADIUS = 6.0f;
+        const float WAYPOINT_OUTLINE = 2.0f;
+        const float WAYPOINT_SELECTED_OUTLINE = 5.0f;
+
+        enum WaypointFlags : std::uint8_t {
+            WAYPOINT_NONE = 0,
+            WAYPOINT_SELECTED = 1 << 0
+        };
+
+        /*
+         * Interned waypoint names, an id stays valid for the lifetime of the program.
+         * Only used from the UI thread.
+         */
+        class NameTable {
+        public:
+            static NameTable &instance();
+
+            std::uint32_t intern(const std::string &name);
+
+            const std::string &get(std::uint32_t id) const;
+
+        private:
+            NameTable();
+
+            std::vector<std::string> _names;
+            std::unordered_map<std::string, std::uint32_t> _ids;
+        };
+
+        /*
+         * A waypoint sits on a grid intersection, the tile is independent of the tile scale
+         */
+        struct Waypoint {
+            sf::Vector2i tile;
+            sf::Color color;
+            std::uint8_t flags = WAYPOINT_NONE;
+            std::uint32_t name = 0;
+        };
+
+        /*
+         * Waypoints of a route stored as a structure of arrays,
+         * so a pass over the route touches only the fields it needs
+         */
+        class WaypointStore {
+        public:
+            std::size_t size() const;
+
+            bool empty() const;
+
+            void clear();
+
+            void push(const Waypoint &waypoint);
+
+            void erase(std::size_t index);
+
+            Waypoint get(std::size_t index) const;
+
+            sf::Vector2i getTile(std::size_t index) const;
+
+            void setTile(std::size_t index, sf::Vector2i tile);
+
+            sf::Color getColor(std::size_t index) const;
+
+            void setColor(std::size_t index, sf::Color color);
+
+            bool hasFlag(std::size_t index, WaypointFlags flag) const;
+
+            void setFlag(std::size_t index, WaypointFlags flag, bool value);
+
+            // Sets or clears the flag on every waypoint
+            void setFlag(WaypointFlags flag, bool value);
+
+            std::uint32_t getName(std::size_t index) const;
+
+            const std::vector<int> &getX() const;
+
+            const std::vector<int> &getY() const;
+
+        private:
+            std::vector<int> _x;
+            std::vector<int> _y;
+            std::vector<sf::Color> _color;
+            std::vector<std::uint8_t> _flags;
+            std::vector<std::uint32_t> _name;
+        };
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "../libext/asio_bluetooth/wrapper.h"
+
+namespace rb {
+    namespace test {
+
+        // Connection which ignores every event but received data
+        class BenchConnection : public Connection {
+        public:
+            explicit BenchConnection(boost::shared_ptr<Hive> hive)
+                    : Connection(hive) {
+            }
+
+        private:
+            void OnAccept(const std::string &addr, uint8_t channel) override {
+            }
+
+            void OnConnect(const std::string &addr, uint8_t channel) override {
+            }
+
+            void OnSend(const std::vector<uint8_t> &buffer) override {
+            }
+
+            void OnTimer(const boost::posix_time::time_duration &delta) override {
+            }
+
+            void OnError(const boost::system::error_code &error) override {
+            }
+        };
+
+        // Acceptor which keeps every connection
+        class BenchAcceptor : public Acceptor {
+        public:
+            explicit BenchAcceptor(boost::shared_ptr<Hive> hive)
+                    : Acceptor(hive) {
+            }
+
+        private:
+            bool OnAccept(boost::shared_ptr<Connection> connection, const std::string &addr, uint8_t channel) override {
+                return true;
+            }
+
+            void OnTimer(const boost::posix_time::time_duration &delta) override {
+            }
+
+            void OnError(const boost::system::error_code &error) override {
+            }
+        };
+    }
+}
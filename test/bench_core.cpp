@@ -0,0 +1,195 @@
+/* bench_core.cpp
+ *
+ * Ack to next send latency of Core. Plays a straight route against an in-process robot which
+ * acknowledges every command the moment it arrives, and measures on the robot the time from
+ * sending an acknowledgement to receiving the next command. That is the time Core needs to
+ * react to an acknowledgement, plus the socket in both directions. Runs once per executor.
+ *
+ *   rembot_bench_core [--executor=thread,strand] [--commands=2000] [--protocol=raw|framed] [--window=1]
+ */
+#include "../src/config.h"
+#include "../src/core.h"
+#include "../src/data.h"
+#include "../src/log.h"
+#include "../src/protocol.h"
+#include "bench_connection.h"
+#include "options.h"
+#include <boost/make_shared.hpp>
+#include <boost/thread/thread.hpp>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+using namespace rb;
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    struct BenchOptions {
+        std::vector<std::string> executors = {"thread", "strand"};
+        int commands = 2000;
+        std::string protocol = "raw";
+        int window = 1;
+    };
+
+    BenchOptions options;
+
+    class AckConnection : public test::BenchConnection {
+    public:
+        explicit AckConnection(boost::shared_ptr<Hive> hive)
+                : BenchConnection(hive) {
+        }
+
+        // Microseconds from an acknowledgement to the next command, read after the run
+        std::vector<long> latencies;
+        std::atomic<int> received{0};
+
+    private:
+        void OnAccept(const std::string &addr, uint8_t channel) {
+            Recv();
+        }
+
+        std::size_t OnRecv(const uint8_t *data, std::size_t size) {
+            Recv();
+
+            if (options.protocol == "framed") {
+                return _parser.parse(data, size, [this](const FrameView &frame) {
+                    if (frame.type == FrameType::Command) command(frame.seq);
+                });
+            }
+
+            std::size_t position = 0;
+            for (; size - position >= 3; position += 3) {
+                command(0);
+            }
+            return position;
+        }
+
+        void command(uint8_t seq) {
+            if (_acked > 0) {
+                latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - _ackTime).count());
+                --_acked;
+            }
+            ++received;
+
+            _ackTime = Clock::now();
+            ++_acked;
+            if (options.protocol == "framed") {
+                Send(encodeFrame(FrameType::Ack, seq));
+            } else {
+                Send({static_cast<uint8_t>(StatusCommand::Ok)});
+            }
+        }
+
+        FrameParser _parser;
+        Clock::time_point _ackTime;
+        // Acknowledgements waiting for the command they release
+        int _acked = 0;
+    };
+
+    // Waits until the UI state of the robot matches or the timeout expires
+    template<class F>
+    bool waitState(Core &core, const std::shared_ptr<StateData> &state, F done) {
+        auto end = Clock::now() + std::chrono::seconds(30);
+        while (Clock::now() < end) {
+            core.update();
+            if (done(state->robots[0])) return true;
+            core.waitUpdate(std::chrono::milliseconds(10));
+        }
+        return false;
+    }
+
+    void run(const std::string &executor) {
+        const std::string base = "/tmp/rembot_bench_core_" + std::to_string(::getpid());
+        const std::string socket = base + ".sock";
+        {
+            std::ofstream config(base + ".config");
+            config << "transport=unix:" << socket << "\n"
+                   << "core_executor=" << executor << "\n"
+                   << "command_protocol=" << options.protocol << "\n"
+                   << "command_window=" << options.window << "\n"
+                   << "fleet_size=1\nhive_threads=1\n";
+        }
+        detail::Config::instance().load(base + ".config");
+
+        boost::shared_ptr<Hive> robotHive(new Hive());
+        auto acceptor = boost::make_shared<test::BenchAcceptor>(robotHive);
+        auto robot = boost::make_shared<AckConnection>(robotHive);
+        acceptor->Listen(ParseEndpoint("unix:" + socket));
+        acceptor->Accept(robot);
+        boost::thread robotThread([robotHive] { robotHive->Run(); });
+
+        std::vector<Command> route(static_cast<std::size_t>(options.commands),
+                                   Command{32, 1, Direction::Up, Direction::Up});
+        auto input = std::make_shared<StateInput>();
+        input->route.publish(route);
+
+        bool finished = false;
+        {
+            Core core;
+            auto state = core.getStateData().lock();
+            core.setStateInput(input);
+            core.init();
+
+            core.notifyEvent(Core::Connect);
+            if (waitState(core, state, [](const RobotState &r) { return r.statusConnection == StatusConnection::Connected; })) {
+                core.notifyEvent(Core::Play);
+                finished = waitState(core, state, [](const RobotState &r) { return r.message == "Finish"; });
+            }
+            core.notifyEvent(Core::Close);
+        }
+
+        robotHive->Stop();
+        robotThread.join();
+        ::unlink(socket.c_str());
+        ::unlink((base + ".config").c_str());
+
+        auto latencies = robot->latencies;
+        if (!finished || latencies.empty()) {
+            std::printf("%-8s did not finish, %d commands received\n", executor.c_str(), robot->received.load());
+            return;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        long mean = 0;
+        for (long latency : latencies) mean += latency;
+        mean /= static_cast<long>(latencies.size());
+
+        std::printf("%-8s %8zu %8ld %8ld %8ld %8ld\n", executor.c_str(), latencies.size(), mean,
+                    latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100], latencies.back());
+        std::fflush(stdout);
+    }
+}
+
+int main(int argc, char **argv) {
+    try {
+        test::parseOptions(argc, argv, [](const std::string &key, const std::string &value) {
+            if (key == "executor") {
+                options.executors = test::parseList(value);
+            } else if (key == "commands") {
+                options.commands = std::stoi(value);
+            } else if (key == "protocol") {
+                options.protocol = value;
+            } else if (key == "window") {
+                options.window = std::stoi(value);
+            } else {
+                return false;
+            }
+            return true;
+        });
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    detail::Logger::instance().setLevel(detail::LogLevel::Warn);
+
+    std::printf("executor     acks  mean_us   p50_us   p99_us   max_us\n");
+    for (const auto &executor : options.executors) {
+        run(executor);
+    }
+    detail::Logger::instance().flush();
+    return 0;
+}
@@ -0,0 +1,146 @@
+/* bench_hive.cpp
+ *
+ * Round trip benchmark of Hive with connection pairs joined by socketpairs. Every client keeps
+ * one 8 byte message in flight which its server echoes back, handlers spin for --work=us to stand
+ * in for parsing and logging. Prints round trips per second and latency for every combination
+ * of thread and connection counts.
+ *
+ *   rembot_bench_hive [--threads=1,2,4] [--connections=1,4,16,64] [--work=20] [--duration=2000]
+ */
+#include "bench_connection.h"
+#include "options.h"
+#include <boost/make_shared.hpp>
+#include <boost/thread/thread.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    const std::size_t MESSAGE_SIZE = 8;
+
+    int workUs = 20;
+
+    void work() {
+        auto end = Clock::now() + std::chrono::microseconds(workUs);
+        while (Clock::now() < end) {
+        }
+    }
+
+    class PingConnection : public rb::test::BenchConnection {
+    public:
+        PingConnection(boost::shared_ptr<Hive> hive, bool client)
+                : BenchConnection(hive), _client(client) {
+        }
+
+        // Round trip times in microseconds, read after the hive stopped
+        const std::vector<long> &getLatencies() const {
+            return _latencies;
+        }
+
+    private:
+        void OnConnect(const std::string &addr, uint8_t channel) {
+            Recv();
+            if (_client) ping();
+        }
+
+        std::size_t OnRecv(const uint8_t *data, std::size_t size) {
+            Recv();
+            work();
+
+            std::size_t position = 0;
+            for (; size - position >= MESSAGE_SIZE; position += MESSAGE_SIZE) {
+                if (_client) {
+                    _latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - _sent).count());
+                    ping();
+                } else {
+                    std::vector<uint8_t> buffer = AcquireBuffer();
+                    buffer.assign(data + position, data + position + MESSAGE_SIZE);
+                    Send(std::move(buffer));
+                }
+            }
+            return position;
+        }
+
+        void ping() {
+            _sent = Clock::now();
+            std::vector<uint8_t> buffer = AcquireBuffer();
+            buffer.resize(MESSAGE_SIZE);
+            Send(std::move(buffer));
+        }
+
+        bool _client;
+        Clock::time_point _sent;
+        std::vector<long> _latencies;
+    };
+
+    void run(int threads, int connections, int durationMs) {
+        boost::shared_ptr<Hive> hive(new Hive());
+        std::vector<boost::shared_ptr<PingConnection>> pairs;
+        for (int i = 0; i < connections; ++i) {
+            auto client = boost::make_shared<PingConnection>(hive, true);
+            auto server = boost::make_shared<PingConnection>(hive, false);
+            Connection::ConnectPair(client, server);
+            pairs.push_back(client);
+            pairs.push_back(server);
+        }
+
+        boost::thread runner([hive, threads] { hive->Run(static_cast<uint32_t>(threads)); });
+        boost::this_thread::sleep(boost::posix_time::milliseconds(durationMs));
+        hive->Stop();
+        runner.join();
+
+        std::vector<long> latencies;
+        for (const auto &connection : pairs) {
+            boost::system::error_code ec;
+            connection->GetSocket().close(ec);
+            latencies.insert(latencies.end(), connection->getLatencies().begin(), connection->getLatencies().end());
+        }
+        std::sort(latencies.begin(), latencies.end());
+
+        double rate = latencies.size() * 1000.0 / durationMs;
+        long mean = 0;
+        for (long latency : latencies) mean += latency;
+        if (!latencies.empty()) mean /= static_cast<long>(latencies.size());
+        long p99 = latencies.empty() ? 0 : latencies[latencies.size() * 99 / 100];
+
+        std::printf("%7d %11d %14.0f %9ld %9ld\n", threads, connections, rate, mean, p99);
+        std::fflush(stdout);
+    }
+}
+
+int main(int argc, char **argv) {
+    std::vector<int> threads = {1, 2, 4};
+    std::vector<int> connections = {1, 4, 16, 64};
+    int durationMs = 2000;
+
+    try {
+        rb::test::parseOptions(argc, argv, [&](const std::string &key, const std::string &value) {
+            if (key == "threads") {
+                threads = rb::test::parseIntList(value);
+            } else if (key == "connections") {
+                connections = rb::test::parseIntList(value);
+            } else if (key == "work") {
+                workUs = std::stoi(value);
+            } else if (key == "duration") {
+                durationMs = std::stoi(value);
+            } else {
+                return false;
+            }
+            return true;
+        });
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    std::printf("threads connections round_trips/s mean_us   p99_us\n");
+    for (int count : connections) {
+        for (int thread : threads) {
+            run(thread, count, durationMs);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+/* bench_path.cpp
+ *
+ * Compile time of PathCompiler for routes like the editor sends on Play. A route is a staircase,
+ * so every waypoint adds a turn, with every --straight waypoint continuing the last segment
+ * instead. Prints the time per compile and per waypoint for every route size.
+ *
+ *   rembot_bench_path [--waypoints=10,100,1000,10000] [--straight=4] [--duration=500]
+ */
+#include "../src/path_compiler.h"
+#include "options.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace rb;
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+
+    void run(int waypoints, int straight, int durationMs) {
+        std::vector<int> xs(1, 0);
+        std::vector<int> ys(1, 0);
+        bool vertical = true;
+        for (int i = 1; i < waypoints; ++i) {
+            if (straight == 0 || i % straight != 0) vertical = !vertical;
+            xs.push_back(xs.back() + (vertical ? 0 : 3));
+            ys.push_back(ys.back() + (vertical ? 2 : 0));
+        }
+
+        PathCompiler compiler(32);
+        std::size_t commands = 0;
+        long compiles = 0;
+        auto start = Clock::now();
+        auto end = start + std::chrono::milliseconds(durationMs);
+        do {
+            commands += compiler.compile(xs, ys).size();
+            ++compiles;
+        } while (Clock::now() < end);
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / compiles;
+
+        std::printf("%9d %9zu %12.0f %10.1f\n", waypoints, commands / compiles, ns, ns / waypoints);
+        std::fflush(stdout);
+    }
+}
+
+int main(int argc, char **argv) {
+    std::vector<int> waypoints = {10, 100, 1000, 10000};
+    int straight = 4;
+    int duration = 500;
+
+    try {
+        test::parseOptions(argc, argv, [&](const std::string &key, const std::string &value) {
+            if (key == "waypoints") {
+                waypoints = test::parseIntList(value);
+            } else if (key == "straight") {
+                straight = std::stoi(value);
+            } else if (key == "duration") {
+                duration = std::stoi(value);
+            } else {
+                return false;
+            }
+            return true;
+        });
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    std::printf("waypoints  commands   ns/compile ns/waypoint\n");
+    for (int count : waypoints) {
+        run(count, straight, duration);
+    }
+    return 0;
+}
@@ -0,0 +1,144 @@
+/* bench_queue.cpp
+ *
+ * Compares the Core input queue, MpscQueue of InlineTask, with the mutex based RingBuffer of
+ * std::function it replaced. Producer threads push tasks like notifyAck does and one consumer
+ * runs them like Core::main. Prints the events per second run by the consumer and the time a
+ * push takes, which is what the render and hive threads pay. A push into a full queue is
+ * retried and counted.
+ *
+ *   rembot_bench_queue [--producers=1,2,4] [--count=200000]
+ */
+#include "../src/queue.h"
+#include "../src/task.h"
+#include "options.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<void()> Task;
+    typedef rb::InlineTask<64> InlineTask;
+
+    const std::size_t QUEUE_SIZE = 256;
+
+    // The queues behind the same interface, the consumer side of RingBuffer blocks in pop
+    struct LockedQueue {
+        rb::RingBuffer<Task, QUEUE_SIZE> queue;
+
+        template<class F>
+        bool push(F &&task) {
+            return queue.push(Task(std::forward<F>(task)));
+        }
+
+        void popAll(std::size_t &done) {
+            queue.pop()();
+            ++done;
+        }
+    };
+
+    template<class T>
+    struct LockFreeQueue {
+        rb::MpscQueue<T, QUEUE_SIZE> queue;
+
+        template<class F>
+        bool push(F &&task) {
+            return queue.push(T(std::forward<F>(task)));
+        }
+
+        void popAll(std::size_t &done) {
+            queue.wait();
+            T task;
+            while (queue.tryPop(task)) {
+                task();
+                ++done;
+            }
+        }
+    };
+
+    template<class Queue>
+    void run(const char *name, int producers, std::size_t count) {
+        Queue queue;
+        std::vector<std::vector<long>> latencies(producers);
+        std::vector<std::size_t> retries(producers, 0);
+        std::size_t sum = 0;
+
+        auto start = Clock::now();
+        std::thread consumer([&queue, producers, count] {
+            std::size_t done = 0;
+            while (done < count * producers) {
+                queue.popAll(done);
+            }
+        });
+
+        std::vector<std::thread> threads;
+        for (int p = 0; p < producers; ++p) {
+            threads.emplace_back([&queue, &latencies, &retries, &sum, p, count] {
+                auto &latency = latencies[p];
+                latency.reserve(count);
+                for (std::size_t i = 0; i < count; ++i) {
+                    while (true) {
+                        auto before = Clock::now();
+                        // Captures as much as an acknowledgement, more than std::function keeps inline.
+                        // Only the consumer runs the task, so the sum needs no lock.
+                        bool pushed = queue.push([&sum, i, p] { sum += i + p; });
+                        latency.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - before).count());
+                        if (pushed) break;
+                        latency.pop_back();
+                        ++retries[p];
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        for (auto &thread : threads) thread.join();
+        consumer.join();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::vector<long> all;
+        std::size_t retried = 0;
+        for (int p = 0; p < producers; ++p) {
+            all.insert(all.end(), latencies[p].begin(), latencies[p].end());
+            retried += retries[p];
+        }
+        std::sort(all.begin(), all.end());
+
+        std::printf("%-22s %9d %10.2f %8ld %8ld %10ld %9zu\n", name, producers, all.size() / seconds / 1e6,
+                    all[all.size() / 2], all[all.size() * 99 / 100], all.back(), retried);
+        std::fflush(stdout);
+    }
+}
+
+int main(int argc, char **argv) {
+    std::vector<int> producers = {1, 2, 4};
+    std::size_t count = 200000;
+
+    try {
+        rb::test::parseOptions(argc, argv, [&](const std::string &key, const std::string &value) {
+            if (key == "producers") {
+                producers = rb::test::parseIntList(value);
+            } else if (key == "count") {
+                count = std::stoul(value);
+            } else {
+                return false;
+            }
+            return true;
+        });
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    std::printf("queue                  producers  Mevents/s  p50_ns   p99_ns     max_ns   retries\n");
+    for (int threads : producers) {
+        run<LockedQueue>("RingBuffer function", threads, count);
+        run<LockFreeQueue<Task>>("MpscQueue function", threads, count);
+        run<LockFreeQueue<InlineTask>>("MpscQueue inline", threads, count);
+    }
+    return 0;
+}
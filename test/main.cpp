@@ -48,12 +48,12 @@ private:
         global_stream_lock.unlock();
     }
 
-    void OnRecv(std::vector<uint8_t> &buffer) {
+    std::size_t OnRecv(const uint8_t *data, std::size_t size) {
         global_stream_lock.lock();
-        std::cout << "[OnRecv] " << buffer.size() << " bytes\n";
-        for(size_t x=0; x<buffer.size(); x++) {
+        std::cout << "[OnRecv] " << size << " bytes\n";
+        for(size_t x=0; x<size; x++) {
 
-            std::cout << (char)buffer[x];
+            std::cout << (char)data[x];
             if((x + 1) % 16 == 0)
                 std::cout << "\n";
         }
@@ -68,6 +68,7 @@ private:
 
         // Start the next receive
         Recv();
+        return size;
     }
 
     void OnTimer(const boost::posix_time::time_duration &delta) {
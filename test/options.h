@@ -0,0 +1,45 @@
+#pragma once
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace rb {
+    namespace test {
+
+        // Comma separated values of an option, like --threads=1,2,4
+        inline std::vector<std::string> parseList(const std::string &value) {
+            std::vector<std::string> list;
+            std::stringstream stream(value);
+            std::string item;
+            while (std::getline(stream, item, ',')) {
+                list.push_back(item);
+            }
+            return list;
+        }
+
+        inline std::vector<int> parseIntList(const std::string &value) {
+            std::vector<int> list;
+            for (const auto &item : parseList(value)) {
+                list.push_back(std::stoi(item));
+            }
+            return list;
+        }
+
+        /*
+         * Calls option(key, value) for every --key=value argument. The option returns false for an
+         * unknown key. Throws std::invalid_argument for an unknown key or any other argument.
+         */
+        template<class F>
+        void parseOptions(int argc, char **argv, F option) {
+            for (int i = 1; i < argc; ++i) {
+                std::string arg = argv[i];
+                std::size_t equals = arg.find('=');
+                if (arg.compare(0, 2, "--") != 0 || equals == std::string::npos) throw std::invalid_argument("Bad option: " + arg);
+                std::string key = arg.substr(2, equals - 2);
+                if (!option(key, arg.substr(equals + 1))) throw std::invalid_argument("Unknown option: " + key);
+            }
+        }
+    }
+}
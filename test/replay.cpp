@@ -0,0 +1,310 @@
+/* replay.cpp
+ *
+ * Replays a capture written by rembot with capture_file set. Listens like rembot_sim and plays
+ * the robot side of the recorded session: bytes the robot sent are sent again with the recorded
+ * gaps, bytes rembot sent are awaited and compared with the ones which arrive. A replayed record
+ * waits for everything rembot sent before it, so the session follows the recorded order even
+ * when rembot is slower or faster than it was.
+ *
+ *   rembot_replay capture.bin [endpoint] [--speed=n] [--robot=i] [--dump]
+ *
+ * The endpoint defaults to tcp:127.0.0.1:5000, set transport in rembot.config to the same value.
+ * The n-th accepted connection replays robot n of the capture, --robot replays the same robot
+ * for every connection. --speed divides the recorded gaps, --speed=0 sends without waiting.
+ * --dump prints the records of the capture and exits.
+ */
+#include "../libext/asio_bluetooth/wrapper.h"
+#include "../src/capture.h"
+#include <boost/make_shared.hpp>
+#include <boost/thread/mutex.hpp>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+
+using namespace rb;
+
+boost::mutex global_stream_lock;
+
+struct ReplayOptions {
+    std::string capture;
+    std::string endpoint = "tcp:127.0.0.1:5000";
+    double speed = 1.0;
+    int robot = -1;
+    bool dump = false;
+};
+
+ReplayOptions options;
+std::vector<CaptureRecord> records;
+
+const char *kindName(CaptureKind kind) {
+    switch (kind) {
+        case CaptureKind::Sent:
+            return "sent";
+        case CaptureKind::Received:
+            return "received";
+        case CaptureKind::Connected:
+            return "connected";
+        case CaptureKind::Closed:
+            return "closed";
+        default:
+            return "unknown";
+    }
+}
+
+void dump() {
+    const uint64_t start = records.empty() ? 0 : records.front().time;
+    for (const auto &record : records) {
+        std::printf("%12.6f robot %u %-9s %4zu", (record.time - start) / 1e9, record.stream, kindName(record.kind),
+                    record.data.size());
+        for (uint8_t byte : record.data) std::printf(" %02x", byte);
+        std::printf("\n");
+    }
+}
+
+class ReplayConnection : public Connection {
+public:
+    ReplayConnection(boost::shared_ptr<Hive> hive, int stream)
+            : Connection(hive), _stream(stream) {
+        // The first session of the robot, rembot may have reconnected during the capture
+        bool connected = false;
+        for (const auto &record : records) {
+            if (record.stream != stream) continue;
+            if (record.kind == CaptureKind::Connected) {
+                if (connected) break;
+                connected = true;
+            }
+            if (record.kind == CaptureKind::Sent) {
+                _expected.insert(_expected.end(), record.data.begin(), record.data.end());
+            }
+            _session.push_back(&record);
+            if (record.kind == CaptureKind::Closed) break;
+        }
+    }
+
+private:
+    void OnAccept(const std::string &addr, uint8_t channel) {
+        global_stream_lock.lock();
+        std::cout << "[OnAccept] robot " << _stream << " " << addr << ", " << _session.size() << " records\n";
+        global_stream_lock.unlock();
+
+        _start = boost::posix_time::microsec_clock::universal_time();
+        _last = _start;
+        Recv();
+        step();
+    }
+
+    void OnConnect(const std::string &addr, uint8_t channel) {
+    }
+
+    void OnSend(const std::vector<uint8_t> &buffer) {
+    }
+
+    std::size_t OnRecv(const uint8_t *data, std::size_t size) {
+        Recv();
+
+        for (std::size_t i = 0; i < size; ++i, ++_received) {
+            if (_received >= _expected.size()) {
+                ++_extra;
+            } else if (_expected[_received] != data[i]) {
+                ++_mismatched;
+            }
+        }
+        if (!_waiting) step();
+        return size;
+    }
+
+    void OnTimer(const boost::posix_time::time_duration &delta) {
+    }
+
+    void OnError(const boost::system::error_code &error) {
+        // Called again for the handlers cancelled by the first error
+        if (_closed) return;
+        _closed = true;
+        report("disconnected");
+    }
+
+    // Plays the records until one has to wait for rembot or for its recorded time
+    void step() {
+        while (_next < _session.size()) {
+            const CaptureRecord &record = *_session[_next];
+            switch (record.kind) {
+                case CaptureKind::Sent:
+                    _sentEnd += record.data.size();
+                    if (_received < _sentEnd) {
+                        _sentEnd -= record.data.size();
+                        return;
+                    }
+                    break;
+                case CaptureKind::Received:
+                    if (!_waiting && options.speed > 0 && _recordTime != 0 && record.time > _recordTime) {
+                        auto gap = static_cast<long>((record.time - _recordTime) / 1000 / options.speed);
+                        auto time = _last + boost::posix_time::microseconds(gap);
+                        if (time > boost::posix_time::microsec_clock::universal_time()) {
+                            wait(time);
+                            return;
+                        }
+                    }
+                    Send(record.data);
+                    break;
+                case CaptureKind::Closed:
+                    ++_next;
+                    _closed = true;
+                    report("replayed");
+                    Disconnect();
+                    return;
+                default:
+                    break;
+            }
+
+            ++_next;
+            _recordTime = record.time;
+            _last = boost::posix_time::microsec_clock::universal_time();
+        }
+    }
+
+    void wait(boost::posix_time::ptime time) {
+        _waiting = true;
+        auto timer = boost::make_shared<boost::asio::deadline_timer>(GetHive()->GetService());
+        timer->expires_at(time);
+        auto self = boost::static_pointer_cast<ReplayConnection>(shared_from_this());
+        timer->async_wait(GetStrand().wrap([self, timer](const boost::system::error_code &error) {
+            if (error || self->_closed) return;
+            self->_waiting = false;
+            // The gap has passed, send the record now
+            self->_recordTime = 0;
+            self->step();
+        }));
+    }
+
+    void report(const char *reason) {
+        long ms = (boost::posix_time::microsec_clock::universal_time() - _start).total_milliseconds();
+        long recorded = 0;
+        if (!_session.empty() && _next > 0) {
+            recorded = static_cast<long>((_session[_next - 1]->time - _session.front()->time) / 1000000);
+        }
+        boost::mutex::scoped_lock lock(global_stream_lock);
+        std::cout << "[" << reason << "] robot " << _stream << " replayed " << _next << " of " << _session.size()
+                  << " records in " << ms << " ms (recorded " << recorded << " ms), received " << _received
+                  << " of " << _expected.size() << " bytes, " << _mismatched << " mismatched, " << _extra
+                  << " extra\n";
+    }
+
+    int _stream;
+    std::vector<const CaptureRecord *> _session;
+    // Everything rembot sent during the session, in order
+    std::vector<uint8_t> _expected;
+    std::size_t _next = 0;
+    std::size_t _received = 0;
+    std::size_t _sentEnd = 0;
+    std::size_t _mismatched = 0;
+    std::size_t _extra = 0;
+    // Time of the last played record in the capture and when it was played
+    uint64_t _recordTime = 0;
+    boost::posix_time::ptime _last;
+    boost::posix_time::ptime _start;
+    bool _waiting = false;
+    bool _closed = false;
+};
+
+class ReplayAcceptor : public Acceptor {
+public:
+    explicit ReplayAcceptor(boost::shared_ptr<Hive> hive)
+            : Acceptor(hive) {
+    }
+
+    void AcceptNext() {
+        int stream = options.robot >= 0 ? options.robot : _robots;
+        ++_robots;
+        Accept(boost::make_shared<ReplayConnection>(GetHive(), stream));
+    }
+
+private:
+    bool OnAccept(boost::shared_ptr<Connection> connection, const std::string &addr, uint8_t channel) {
+        AcceptNext();
+        return true;
+    }
+
+    void OnTimer(const boost::posix_time::time_duration &delta) {
+    }
+
+    void OnError(const boost::system::error_code &error) {
+        global_stream_lock.lock();
+        std::cout << "[OnError] " << error.message() << "\n";
+        global_stream_lock.unlock();
+    }
+
+    int _robots = 0;
+};
+
+void parseOptions(int argc, char **argv) {
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--dump") {
+            options.dump = true;
+            continue;
+        }
+        if (arg.compare(0, 2, "--") != 0) {
+            positional.push_back(arg);
+            continue;
+        }
+
+        std::size_t equals = arg.find('=');
+        if (equals == std::string::npos) throw std::invalid_argument("Bad option: " + arg);
+        std::string key = arg.substr(2, equals - 2);
+        std::string value = arg.substr(equals + 1);
+
+        if (key == "speed") {
+            options.speed = std::stod(value);
+        } else if (key == "robot") {
+            options.robot = std::stoi(value);
+        } else {
+            throw std::invalid_argument("Unknown option: " + key);
+        }
+    }
+
+    if (positional.empty() || positional.size() > 2) {
+        throw std::invalid_argument("Usage: rembot_replay capture.bin [endpoint] [--speed=n] [--robot=i] [--dump]");
+    }
+    options.capture = positional[0];
+    if (positional.size() == 2) options.endpoint = positional[1];
+}
+
+int main(int argc, char **argv) {
+    try {
+        parseOptions(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    CaptureReader reader;
+    if (!reader.open(options.capture)) {
+        std::cerr << "Not a capture: " << options.capture << "\n";
+        return 1;
+    }
+    CaptureRecord record;
+    while (reader.next(record)) {
+        records.push_back(record);
+    }
+
+    if (options.dump) {
+        dump();
+        return 0;
+    }
+
+    boost::shared_ptr<Hive> hive(new Hive());
+    boost::shared_ptr<ReplayAcceptor> acceptor(new ReplayAcceptor(hive));
+    try {
+        acceptor->Listen(ParseEndpoint(options.endpoint));
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    acceptor->AcceptNext();
+
+    std::cout << "[Listen] " << options.endpoint << ", " << records.size() << " records\n";
+    hive->Run();
+
+    return 0;
+}
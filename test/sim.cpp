@@ -0,0 +1,432 @@
+/* sim.cpp
+ *
+ * Simulated NXT robot. Listens on a local socket, executes the commands of rembot against a
+ * simulated pose and answers like the robot does, so missions can be run and timed without
+ * a real robot. Every accepted connection is a separate robot.
+ *
+ *   rembot_sim [endpoint] [--exec=ms] [--exec-tile=ms] [--latency=ms] [--jitter=ms]
+ *              [--loss=0..1] [--reject=0..1] [--start=x,y,heading] [--seed=n] [--trace=file]
+ *
+ * The endpoint defaults to tcp:127.0.0.1:5000, set transport in rembot.config to the same value.
+ * Raw and framed commands are told apart by the first byte the robot receives.
+ *
+ * Each executed command prints a line "pose <robot> <n> <ms> <x> <y> <heading>" with the time
+ * since the first command, to stdout or to the trace file, to compare it with the planned route.
+ */
+#include "../libext/asio_bluetooth/wrapper.h"
+#include "../src/data.h"
+#include "../src/protocol.h"
+#include <boost/make_shared.hpp>
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+using namespace rb;
+
+boost::mutex global_stream_lock;
+
+struct SimOptions {
+    std::string endpoint = "tcp:127.0.0.1:5000";
+    // Time to execute one command and extra time per tile it moves
+    int execMs = 200;
+    int execTileMs = 100;
+    // One way link delay and its random addition
+    int latencyMs = 20;
+    int jitterMs = 0;
+    // Probability that a message in either direction is lost
+    double loss = 0.0;
+    // Probability that the robot rejects a command
+    double reject = 0.0;
+    int startX = 0;
+    int startY = 0;
+    Direction startHeading = Direction::Up;
+    unsigned int seed = 1;
+    std::string trace;
+};
+
+SimOptions options;
+std::ofstream traceFile;
+
+const char *headingName(Direction heading) {
+    switch (heading) {
+        case Direction::Up:
+            return "up";
+        case Direction::Down:
+            return "down";
+        case Direction::Left:
+            return "left";
+        default:
+            return "right";
+    }
+}
+
+Direction parseHeading(const std::string &name) {
+    if (name == "up") return Direction::Up;
+    if (name == "down") return Direction::Down;
+    if (name == "left") return Direction::Left;
+    if (name == "right") return Direction::Right;
+    throw std::invalid_argument("Bad heading: " + name);
+}
+
+Direction turn(Direction heading, bool clockwise) {
+    switch (heading) {
+        case Direction::Up:
+            return clockwise ? Direction::Right : Direction::Left;
+        case Direction::Right:
+            return clockwise ? Direction::Down : Direction::Up;
+        case Direction::Down:
+            return clockwise ? Direction::Left : Direction::Right;
+        default:
+            return clockwise ? Direction::Up : Direction::Down;
+    }
+}
+
+class SimConnection : public Connection {
+public:
+    SimConnection(boost::shared_ptr<Hive> hive, int id)
+            : Connection(hive), _id(id), _random(options.seed + id) {
+        _pose = {options.startX, options.startY, options.startHeading};
+    }
+
+private:
+    enum class Mode {
+        Unknown,
+        Raw,
+        Framed
+    };
+
+    struct Pose {
+        int x;
+        int y;
+        Direction heading;
+    };
+
+    struct Pending {
+        uint8_t seq;
+        Command command;
+    };
+
+    void OnAccept(const std::string &addr, uint8_t channel) {
+        global_stream_lock.lock();
+        std::cout << "[OnAccept] robot " << _id << " " << addr << "\n";
+        global_stream_lock.unlock();
+
+        Recv();
+    }
+
+    void OnConnect(const std::string &addr, uint8_t channel) {
+    }
+
+    void OnSend(const std::vector<uint8_t> &buffer) {
+    }
+
+    std::size_t OnRecv(const uint8_t *data, std::size_t size) {
+        Recv();
+
+        if (_mode == Mode::Unknown) {
+            _mode = data[0] == protocol::MAGIC_0 ? Mode::Framed : Mode::Raw;
+        }
+
+        if (_mode == Mode::Framed) {
+            return _parser.parse(data, size, [this](const FrameView &frame) {
+                if (frame.type == FrameType::Stop) {
+                    deliver([this] { stop(); });
+                } else if (frame.type == FrameType::Command && frame.size >= 3) {
+                    receive(frame.seq, frame.payload);
+                }
+            });
+        }
+
+        // Raw commands are three bytes, the stop request is one
+        std::size_t position = 0;
+        while (position < size) {
+            if (data[position] == StatusControl::Stop) {
+                deliver([this] { stop(); });
+                ++position;
+            } else if (size - position >= 3) {
+                receive(0, data + position);
+                position += 3;
+            } else {
+                break;
+            }
+        }
+        return position;
+    }
+
+    void OnTimer(const boost::posix_time::time_duration &delta) {
+    }
+
+    void OnError(const boost::system::error_code &error) {
+        // Called again for the handlers cancelled by the first error
+        if (_closed) return;
+        _closed = true;
+        ++_generation;
+        _queue.clear();
+        report("disconnected");
+    }
+
+    bool lost() {
+        return options.loss > 0 && std::uniform_real_distribution<double>(0, 1)(_random) < options.loss;
+    }
+
+    // Time when a message sent now arrives. Links keep the order of messages, so a message
+    // never overtakes the one before it even with jitter.
+    boost::posix_time::ptime arrival(boost::posix_time::ptime &last) {
+        int delay = options.latencyMs;
+        if (options.jitterMs > 0) {
+            delay += std::uniform_int_distribution<int>(0, options.jitterMs)(_random);
+        }
+        auto now = boost::posix_time::microsec_clock::universal_time();
+        auto time = now + boost::posix_time::milliseconds(delay);
+        if (last.is_not_a_date_time() || last < time) last = time;
+        return last;
+    }
+
+    template<class F>
+    void at(boost::posix_time::ptime time, F handler) {
+        auto timer = boost::make_shared<boost::asio::deadline_timer>(GetHive()->GetService());
+        timer->expires_at(time);
+        auto self = shared_from_this();
+        timer->async_wait(GetStrand().wrap([self, timer, handler](const boost::system::error_code &error) {
+            if (!error) handler();
+        }));
+    }
+
+    template<class F>
+    void deliver(F handler) {
+        if (lost()) {
+            ++_lost;
+            return;
+        }
+        at(arrival(_lastInbound), handler);
+    }
+
+    void receive(uint8_t seq, const uint8_t *payload) {
+        Command command{payload[2], payload[1], static_cast<Direction>(payload[0]), _pose.heading};
+        deliver([this, seq, command] {
+            _queue.push_back(Pending{seq, command});
+            if (_queue.size() == 1) execute();
+        });
+    }
+
+    void execute() {
+        if (_queue.empty()) return;
+        if (_start.is_not_a_date_time()) {
+            _start = boost::posix_time::microsec_clock::universal_time();
+            trace();
+        }
+
+        const Command &command = _queue.front().command;
+        int duration = options.execMs + options.execTileMs * command.length;
+        int generation = _generation;
+        at(boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(duration),
+           [this, generation] {
+               if (generation == _generation) complete();
+           });
+    }
+
+    void complete() {
+        Pending pending = _queue.front();
+        _queue.pop_front();
+
+        bool accepted = options.reject <= 0 || std::uniform_real_distribution<double>(0, 1)(_random) >= options.reject;
+        if (accepted && !apply(pending.command)) accepted = false;
+        if (accepted) {
+            ++_executed;
+            trace();
+        }
+
+        reply(pending.seq, accepted);
+        execute();
+    }
+
+    bool apply(const Command &command) {
+        int sign = 1;
+        switch (command.direction) {
+            case Direction::Left:
+                _pose.heading = turn(_pose.heading, false);
+                return true;
+            case Direction::Right:
+                _pose.heading = turn(_pose.heading, true);
+                return true;
+            case Direction::Down:
+                sign = -1;
+                // fall through
+            case Direction::Up:
+                switch (_pose.heading) {
+                    case Direction::Up:
+                        _pose.y -= sign * command.length;
+                        break;
+                    case Direction::Down:
+                        _pose.y += sign * command.length;
+                        break;
+                    case Direction::Left:
+                        _pose.x -= sign * command.length;
+                        break;
+                    case Direction::Right:
+                        _pose.x += sign * command.length;
+                        break;
+                }
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    void reply(uint8_t seq, bool accepted) {
+        std::vector<uint8_t> buffer;
+        if (_mode == Mode::Framed) {
+            buffer = encodeFrame(accepted ? FrameType::Ack : FrameType::Nak, seq);
+        } else {
+            buffer.push_back(static_cast<uint8_t>(accepted ? StatusCommand::Ok : StatusCommand::No));
+        }
+        if (lost()) {
+            ++_lost;
+            return;
+        }
+        auto self = shared_from_this();
+        at(arrival(_lastOutbound), [self, buffer] {
+            self->Send(buffer);
+        });
+    }
+
+    void stop() {
+        ++_generation;
+        _queue.clear();
+        report("stopped");
+    }
+
+    void trace() {
+        long ms = (boost::posix_time::microsec_clock::universal_time() - _start).total_milliseconds();
+        boost::mutex::scoped_lock lock(global_stream_lock);
+        std::ostream &out = traceFile.is_open() ? static_cast<std::ostream &>(traceFile) : std::cout;
+        out << "pose " << _id << " " << _executed << " " << ms << " " << _pose.x << " " << _pose.y << " "
+            << headingName(_pose.heading) << "\n";
+        out.flush();
+    }
+
+    void report(const char *reason) {
+        long ms = _start.is_not_a_date_time() ? 0
+                  : (boost::posix_time::microsec_clock::universal_time() - _start).total_milliseconds();
+        boost::mutex::scoped_lock lock(global_stream_lock);
+        std::cout << "[" << reason << "] robot " << _id << " executed " << _executed << " commands in " << ms
+                  << " ms, lost " << _lost << " messages\n";
+    }
+
+    int _id;
+    std::mt19937 _random;
+    Mode _mode = Mode::Unknown;
+    FrameParser _parser;
+    Pose _pose;
+    std::deque<Pending> _queue;
+    // Bumped by stop, commands started before it are not completed
+    int _generation = 0;
+    int _executed = 0;
+    int _lost = 0;
+    bool _closed = false;
+    boost::posix_time::ptime _start;
+    boost::posix_time::ptime _lastInbound;
+    boost::posix_time::ptime _lastOutbound;
+};
+
+class SimAcceptor : public Acceptor {
+public:
+    explicit SimAcceptor(boost::shared_ptr<Hive> hive)
+            : Acceptor(hive) {
+    }
+
+    // Keeps one connection waiting, so robots can connect at any time
+    void AcceptNext() {
+        Accept(boost::make_shared<SimConnection>(GetHive(), ++_robots));
+    }
+
+private:
+    bool OnAccept(boost::shared_ptr<Connection> connection, const std::string &addr, uint8_t channel) {
+        AcceptNext();
+        return true;
+    }
+
+    void OnTimer(const boost::posix_time::time_duration &delta) {
+    }
+
+    void OnError(const boost::system::error_code &error) {
+        global_stream_lock.lock();
+        std::cout << "[OnError] " << error.message() << "\n";
+        global_stream_lock.unlock();
+    }
+
+    int _robots = 0;
+};
+
+void parseOptions(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) {
+            options.endpoint = arg;
+            continue;
+        }
+
+        std::size_t equals = arg.find('=');
+        if (equals == std::string::npos) throw std::invalid_argument("Bad option: " + arg);
+        std::string key = arg.substr(2, equals - 2);
+        std::string value = arg.substr(equals + 1);
+
+        if (key == "exec") {
+            options.execMs = std::stoi(value);
+        } else if (key == "exec-tile") {
+            options.execTileMs = std::stoi(value);
+        } else if (key == "latency") {
+            options.latencyMs = std::stoi(value);
+        } else if (key == "jitter") {
+            options.jitterMs = std::stoi(value);
+        } else if (key == "loss") {
+            options.loss = std::stod(value);
+        } else if (key == "reject") {
+            options.reject = std::stod(value);
+        } else if (key == "seed") {
+            options.seed = static_cast<unsigned int>(std::stoul(value));
+        } else if (key == "trace") {
+            options.trace = value;
+        } else if (key == "start") {
+            std::size_t first = value.find(',');
+            std::size_t second = value.find(',', first + 1);
+            if (first == std::string::npos || second == std::string::npos) throw std::invalid_argument("Bad start: " + value);
+            options.startX = std::stoi(value.substr(0, first));
+            options.startY = std::stoi(value.substr(first + 1, second - first - 1));
+            options.startHeading = parseHeading(value.substr(second + 1));
+        } else {
+            throw std::invalid_argument("Unknown option: " + key);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    try {
+        parseOptions(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    if (!options.trace.empty()) {
+        traceFile.open(options.trace);
+    }
+
+    boost::shared_ptr<Hive> hive(new Hive());
+    boost::shared_ptr<SimAcceptor> acceptor(new SimAcceptor(hive));
+    try {
+        acceptor->Listen(ParseEndpoint(options.endpoint));
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+    acceptor->AcceptNext();
+
+    std::cout << "[Listen] " << options.endpoint << "\n";
+    hive->Run();
+
+    return 0;
+}
@@ -0,0 +1,103 @@
+/* test_path.cpp
+ *
+ * Checks the commands PathCompiler emits for small routes. Prints every failed check and exits
+ * with 1 if there was one.
+ *
+ *   rembot_test_path
+ */
+#include "../src/path_compiler.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace rb;
+
+namespace {
+    const int TILE_SIZE = 32;
+
+    int failures = 0;
+
+    Command move(int length, Direction heading) {
+        return Command{TILE_SIZE, length, Direction::Up, heading};
+    }
+
+    Command turn(Direction side, Direction heading) {
+        return Command{TILE_SIZE, 0, side, heading};
+    }
+
+    std::string format(const std::vector<Command> &commands) {
+        std::string text;
+        for (const auto &command : commands) {
+            text += " {" + std::to_string(command.size) + "," + std::to_string(command.length) + "," +
+                    std::to_string(command.direction) + "," + std::to_string(command.view) + "}";
+        }
+        return text.empty() ? " (none)" : text;
+    }
+
+    void expect(const char *name, const std::vector<int> &xs, const std::vector<int> &ys,
+                const std::vector<Command> &expected) {
+        auto commands = PathCompiler(TILE_SIZE).compile(xs, ys);
+
+        bool equal = commands.size() == expected.size();
+        for (std::size_t i = 0; equal && i < commands.size(); ++i) {
+            equal = commands[i].size == expected[i].size && commands[i].length == expected[i].length &&
+                    commands[i].direction == expected[i].direction && commands[i].view == expected[i].view;
+        }
+        if (equal) return;
+
+        ++failures;
+        std::printf("FAIL %s\n  expected%s\n  got     %s\n", name, format(expected).c_str(), format(commands).c_str());
+    }
+}
+
+int main() {
+    expect("single tile", {2}, {2}, {});
+
+    expect("repeated tile", {2, 2}, {2, 2}, {});
+
+    expect("collinear moves are merged", {0, 0, 0}, {0, 3, 5}, {
+            move(5, Direction::Down)
+    });
+
+    expect("right turn", {0, 0, 3}, {5, 0, 0}, {
+            move(5, Direction::Up),
+            turn(Direction::Right, Direction::Right),
+            move(3, Direction::Right)
+    });
+
+    expect("left turn", {3, 3, 0}, {5, 0, 0}, {
+            move(5, Direction::Up),
+            turn(Direction::Left, Direction::Left),
+            move(3, Direction::Left)
+    });
+
+    expect("reversal is two right turns", {0, 0, 0}, {0, 3, 1}, {
+            move(3, Direction::Down),
+            turn(Direction::Right, Direction::Left),
+            turn(Direction::Right, Direction::Up),
+            move(2, Direction::Up)
+    });
+
+    expect("diagonal is vertical then horizontal", {0, 2}, {0, 4}, {
+            move(4, Direction::Down),
+            turn(Direction::Left, Direction::Right),
+            move(2, Direction::Right)
+    });
+
+    expect("long move is split at MAX_LENGTH", {0, 0}, {0, 2 * PathCompiler::MAX_LENGTH + 90}, {
+            move(PathCompiler::MAX_LENGTH, Direction::Down),
+            move(PathCompiler::MAX_LENGTH, Direction::Down),
+            move(90, Direction::Down)
+    });
+
+    expect("move of exactly MAX_LENGTH is not split", {0, PathCompiler::MAX_LENGTH}, {0, 0}, {
+            move(PathCompiler::MAX_LENGTH, Direction::Right)
+    });
+
+    if (failures > 0) {
+        std::printf("%d failed\n", failures);
+        return 1;
+    }
+    std::printf("all passed\n");
+    return 0;
+}